@@ -11,6 +11,75 @@ VNEFrameType :: enum c.int {
 }
 
 VNEVideo :: struct { _ : u8 }
+VNEVideoPack :: struct { _ : u8 }
+VNEVideoPreload :: struct { _ : u8 }
+VNEScheduler :: struct { _ : u8 }
+
+VNE_SEEK_ACCURATE :: 1
+
+VNEThreadType :: enum c.int {
+    VNE_THREAD_AUTO  = 0,
+    VNE_THREAD_FRAME = 1,
+    VNE_THREAD_SLICE = 2,
+}
+
+VNEPixelFormat :: enum c.int {
+    VNE_PIXEL_RGBA = 0,
+    VNE_PIXEL_I420 = 1,
+    VNE_PIXEL_NV12 = 2,
+    VNE_PIXEL_P010 = 3,
+}
+
+VNESampleFormat :: enum c.int {
+    VNE_SAMPLE_S16  = 0,
+    VNE_SAMPLE_F32  = 1,
+    VNE_SAMPLE_S16P = 2,
+    VNE_SAMPLE_F32P = 3,
+}
+
+VNEColorSpace :: enum c.int {
+    VNE_COLORSPACE_BT601  = 0,
+    VNE_COLORSPACE_BT709  = 1,
+    VNE_COLORSPACE_BT2020 = 2,
+}
+
+VNEColorRange :: enum c.int {
+    VNE_RANGE_LIMITED = 0,
+    VNE_RANGE_FULL    = 1,
+}
+
+VNEScaleFilter :: enum c.int {
+    VNE_SCALE_BILINEAR      = 0,
+    VNE_SCALE_FAST_BILINEAR = 1,
+    VNE_SCALE_BICUBIC       = 2,
+    VNE_SCALE_AREA          = 3,
+    VNE_SCALE_LANCZOS       = 4,
+    VNE_SCALE_POINT         = 5,
+}
+
+VNEOpenOptions :: struct {
+    video_threads:     c.int,
+    video_thread_type: c.int,
+    audio_threads:     c.int,
+    audio_thread_type: c.int,
+    output_format:     c.int, // VNEPixelFormat
+    target_width:      c.int,
+    target_height:     c.int,
+    scale_filter:      c.int, // VNEScaleFilter
+    allow_lowres:      c.int,
+    convert_threads:   c.int,
+    probesize:           i64,
+    analyze_duration_ms: i64,
+    disable_video:     c.int,
+    disable_audio:     c.int,
+    audio_ring_ms:     c.int,
+    audio_format:      c.int, // VNESampleFormat
+    audio_sample_rate: c.int,
+    audio_channels:    c.int,
+    loop:              c.int,
+    frame_cache_bytes: i64,
+    skip_repeats: c.int,
+}
 
 VNEVideoInfo :: struct {
     width:      c.int,
@@ -29,6 +98,20 @@ VNEVideoFrame :: struct {
     stride: c.int,
     pts_ms: i64,
     data:   ^u8, // RGBA
+    repeat: c.int,
+}
+
+VNEPlanarFrame :: struct {
+    width:       c.int,
+    height:      c.int,
+    format:      c.int, // VNEPixelFormat
+    plane_count: c.int,
+    planes:      [3]^u8,
+    strides:     [3]c.int,
+    colorspace:  c.int, // VNEColorSpace
+    color_range: c.int, // VNEColorRange
+    pts_ms:      i64,
+    priv:        rawptr,
 }
 
 VNEAudioFrame :: struct {
@@ -37,20 +120,68 @@ VNEAudioFrame :: struct {
     nb_samples:      c.int,
     bytes_per_sample:c.int,
     pts_ms:          i64,
-    data:            ^u8, // interleaved S16
+    data:            ^u8, // interleaved, or the first plane
+    sample_format:   c.int, // VNESampleFormat
+    plane_stride:    c.int,
 }
 
 foreign import vnef_video "../../build/libvnef_video.so"
 
 foreign vnef_video {
     vne_video_open             :: proc(path: cstring, out_info: ^VNEVideoInfo) -> ^VNEVideo ---
+    vne_video_default_options  :: proc(opts: ^VNEOpenOptions) ---
+    vne_video_open_ex          :: proc(path: cstring, opts: ^VNEOpenOptions, out_info: ^VNEVideoInfo) -> ^VNEVideo ---
+    vne_video_open_memory      :: proc(data: rawptr, size: c.size_t, opts: ^VNEOpenOptions, out_info: ^VNEVideoInfo) -> ^VNEVideo ---
+
+    vne_video_pack_open        :: proc(path: cstring) -> ^VNEVideoPack ---
+    vne_video_pack_close       :: proc(pack: ^VNEVideoPack) ---
+    vne_video_pack_count       :: proc(pack: ^VNEVideoPack) -> c.int ---
+    vne_video_pack_find        :: proc(pack: ^VNEVideoPack, name: cstring) -> c.int ---
+    vne_video_pack_name        :: proc(pack: ^VNEVideoPack, index: c.int) -> cstring ---
+    vne_video_pack_info        :: proc(pack: ^VNEVideoPack, index: c.int, out_info: ^VNEVideoInfo) -> c.int ---
+    vne_video_pack_open_entry  :: proc(pack: ^VNEVideoPack, index: c.int, opts: ^VNEOpenOptions, out_info: ^VNEVideoInfo) -> ^VNEVideo ---
+    vne_video_pack_open_name   :: proc(pack: ^VNEVideoPack, name: cstring, opts: ^VNEOpenOptions, out_info: ^VNEVideoInfo) -> ^VNEVideo ---
+
+    vne_video_reopen           :: proc(v: ^VNEVideo, path: cstring, out_info: ^VNEVideoInfo) -> ^VNEVideo ---
+
+    vne_video_preload_start    :: proc(paths: [^]cstring, count: c.int, opts: ^VNEOpenOptions, threads: c.int) -> ^VNEVideoPreload ---
+    vne_video_preload_poll     :: proc(p: ^VNEVideoPreload, index: c.int) -> c.int ---
+    vne_video_preload_take     :: proc(p: ^VNEVideoPreload, index: c.int, out_info: ^VNEVideoInfo) -> ^VNEVideo ---
+    vne_video_preload_free     :: proc(p: ^VNEVideoPreload) ---
     vne_video_close            :: proc(v: ^VNEVideo) ---
     vne_video_last_error       :: proc(v: ^VNEVideo) -> cstring ---
 
     vne_video_next             :: proc(v: ^VNEVideo, out_video: ^VNEVideoFrame, out_audio: ^VNEAudioFrame) -> VNEFrameType ---
+    vne_video_next_into        :: proc(v: ^VNEVideo, dst: ^u8, dst_stride: c.int, out_video: ^VNEVideoFrame, out_audio: ^VNEAudioFrame) -> VNEFrameType ---
+
+    vne_video_next_planar      :: proc(v: ^VNEVideo, out_video: ^VNEPlanarFrame, out_audio: ^VNEAudioFrame) -> VNEFrameType ---
+
+    vne_video_next_video       :: proc(v: ^VNEVideo, out_video: ^VNEVideoFrame) -> VNEFrameType ---
+    vne_video_next_audio       :: proc(v: ^VNEVideo, out_audio: ^VNEAudioFrame) -> VNEFrameType ---
+
+    vne_video_update           :: proc(v: ^VNEVideo, now_ms: i64, out_video: ^VNEVideoFrame, out_dropped: ^c.int) -> VNEFrameType ---
+
+    vne_video_start_async      :: proc(v: ^VNEVideo, queue_depth: c.int) -> c.int ---
+    vne_video_stop_async       :: proc(v: ^VNEVideo) ---
+
+    vne_scheduler_create       :: proc(threads: c.int) -> ^VNEScheduler ---
+    vne_scheduler_add          :: proc(s: ^VNEScheduler, v: ^VNEVideo, queue_depth: c.int) -> c.int ---
+    vne_scheduler_remove       :: proc(s: ^VNEScheduler, v: ^VNEVideo) ---
+    vne_scheduler_destroy      :: proc(s: ^VNEScheduler) ---
+
+    vne_video_read_audio       :: proc(v: ^VNEVideo, dst: rawptr, nb_samples: c.int) -> c.int ---
+    vne_video_audio_underruns  :: proc(v: ^VNEVideo) -> c.int ---
 
     vne_video_free_video_frame :: proc(f: ^VNEVideoFrame) ---
+    vne_video_free_planar_frame :: proc(f: ^VNEPlanarFrame) ---
     vne_video_free_audio_frame :: proc(f: ^VNEAudioFrame) ---
 
+    vne_video_frame_at_ms      :: proc(v: ^VNEVideo, target_ms: i64, out_video: ^VNEVideoFrame) -> VNEFrameType ---
+    vne_video_step_back        :: proc(v: ^VNEVideo, out_video: ^VNEVideoFrame) -> VNEFrameType ---
+
+    vne_video_thumbnail        :: proc(path: cstring, time_ms: i64, max_w: c.int, max_h: c.int, out: ^VNEVideoFrame) -> c.int ---
+    vne_video_thumbnails       :: proc(path: cstring, count: c.int, max_w: c.int, max_h: c.int, out: [^]VNEVideoFrame) -> c.int ---
+
     vne_video_seek_ms          :: proc(v: ^VNEVideo, target_ms: i64) -> c.int ---
+    vne_video_seek_ex          :: proc(v: ^VNEVideo, target_ms: i64, flags: c.int) -> c.int ---
 }
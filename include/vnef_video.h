@@ -5,6 +5,7 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
 #include <stdint.h>
 
 #if defined(_WIN32) && defined(VNEF_VIDEO_BUILD_DLL)
@@ -16,6 +17,9 @@ extern "C" {
 #endif
 
 typedef struct VNEVideo VNEVideo;
+typedef struct VNEVideoPack VNEVideoPack;
+typedef struct VNEVideoPreload VNEVideoPreload;
+typedef struct VNEScheduler VNEScheduler;
 
 typedef enum VNEFrameType {
     VNE_FRAME_NONE  = 0,
@@ -25,14 +29,84 @@ typedef enum VNEFrameType {
     VNE_FRAME_ERROR = -1,
 } VNEFrameType;
 
+// Decoder threading flags for VNEOpenOptions.
+typedef enum VNEThreadType {
+    VNE_THREAD_AUTO  = 0, // frame + slice, whatever the codec supports
+    VNE_THREAD_FRAME = 1,
+    VNE_THREAD_SLICE = 2,
+} VNEThreadType;
+
+// Video output formats. RGBA frames come from vne_video_next; the planar
+// formats from vne_video_next_planar.
+typedef enum VNEPixelFormat {
+    VNE_PIXEL_RGBA = 0,
+    VNE_PIXEL_I420 = 1, // 8-bit Y, U, V planes, chroma halved both ways
+    VNE_PIXEL_NV12 = 2, // 8-bit Y plane + interleaved UV plane
+    VNE_PIXEL_P010 = 3, // 16-bit little-endian NV12, 10 significant high bits
+} VNEPixelFormat;
+
+typedef enum VNEColorSpace {
+    VNE_COLORSPACE_BT601  = 0,
+    VNE_COLORSPACE_BT709  = 1,
+    VNE_COLORSPACE_BT2020 = 2,
+} VNEColorSpace;
+
+typedef enum VNEColorRange {
+    VNE_RANGE_LIMITED = 0, // 16-235 (8-bit)
+    VNE_RANGE_FULL    = 1, // 0-255
+} VNEColorRange;
+
+// Filter used when frames are scaled to target_width x target_height.
+typedef enum VNEScaleFilter {
+    VNE_SCALE_BILINEAR      = 0,
+    VNE_SCALE_FAST_BILINEAR = 1,
+    VNE_SCALE_BICUBIC       = 2,
+    VNE_SCALE_AREA          = 3, // best for large downscales
+    VNE_SCALE_LANCZOS       = 4,
+    VNE_SCALE_POINT         = 5,
+} VNEScaleFilter;
+
+// Audio output formats. Planar formats put each channel in its own plane.
+typedef enum VNESampleFormat {
+    VNE_SAMPLE_S16  = 0, // interleaved signed 16-bit
+    VNE_SAMPLE_F32  = 1, // interleaved float
+    VNE_SAMPLE_S16P = 2,
+    VNE_SAMPLE_F32P = 3,
+} VNESampleFormat;
+
+// Always initialize with vne_video_default_options before changing fields.
+typedef struct VNEOpenOptions {
+    int video_threads;     // decoder threads, 0 = one per core
+    int video_thread_type; // VNEThreadType flags
+    int audio_threads;     // default 1
+    int audio_thread_type; // VNEThreadType flags
+    int output_format;     // VNEPixelFormat, default RGBA
+    int target_width;      // output size, 0 = source (or keep aspect if the other is set)
+    int target_height;
+    int scale_filter;      // VNEScaleFilter
+    int allow_lowres;      // let codecs that support it decode at 1/2, 1/4, ... size
+    int convert_threads;   // threads for sliced RGBA/YUV conversion, default 1, 0 = one per core
+    int64_t probesize;           // max bytes probed when opening, 0 = FFmpeg default
+    int64_t analyze_duration_ms; // max media time analyzed for stream info, 0 = FFmpeg default
+    int disable_video;     // audio-only handle: video packets are skipped by the demuxer
+    int disable_audio;     // video-only handle: audio packets are skipped by the demuxer
+    int audio_ring_ms;     // > 0: decode audio into a sample ring of this length (vne_video_read_audio)
+    int audio_format;      // VNESampleFormat, default S16
+    int audio_sample_rate; // output rate, 0 = source
+    int audio_channels;    // output channels (default layout for the count), 0 = source
+    int loop;              // restart at the end without a flush; pts keeps increasing across loops
+    int64_t frame_cache_bytes; // > 0: keep converted RGBA frames up to this size for scrubbing (LRU)
+    int skip_repeats;      // RGBA: frames identical to the previous one skip conversion (VNEVideoFrame.repeat)
+} VNEOpenOptions;
+
 typedef struct VNEVideoInfo {
-    int width;
+    int width;  // output size (after target_width/target_height), 0 without video
     int height;
     int fps_num;
     int fps_den;
     int64_t duration_ms;
     int has_audio;
-    int sample_rate;
+    int sample_rate; // output rate and channels
     int channels;
 } VNEVideoInfo;
 
@@ -42,30 +116,198 @@ typedef struct VNEVideoFrame {
     int stride;
     int64_t pts_ms;
     uint8_t *data;   // RGBA
+    int repeat;      // skip_repeats: same image as the previous frame, no upload needed
 } VNEVideoFrame;
 
+// YUV output for shader-side conversion. When the decoder already produces the
+// requested format the planes point straight into the decoded frame.
+typedef struct VNEPlanarFrame {
+    int width;
+    int height;
+    int format;        // VNEPixelFormat
+    int plane_count;   // 3 for I420, 2 for NV12/P010
+    uint8_t *planes[3];
+    int strides[3];
+    int colorspace;    // VNEColorSpace
+    int color_range;   // VNEColorRange
+    int64_t pts_ms;
+    void *priv;        // internal
+} VNEPlanarFrame;
+
 typedef struct VNEAudioFrame {
     int sample_rate;
     int channels;
     int nb_samples;
-    int bytes_per_sample; // 2 for S16
+    int bytes_per_sample; // 2 for S16, 4 for F32
     int64_t pts_ms;
-    uint8_t *data;         // interleaved S16
+    uint8_t *data;         // interleaved, or the first plane of a planar format
+    int sample_format;     // VNESampleFormat
+    int plane_stride;      // planar: channel c starts at data + c * plane_stride
 } VNEAudioFrame;
 
 // Opens a media file or a custom .video container (header + raw WebM bytes).
 VNEF_VIDEO_API VNEVideo *vne_video_open(const char *path, VNEVideoInfo *out_info);
+
+// Same as vne_video_open with explicit options. opts may be NULL for defaults.
+VNEF_VIDEO_API void vne_video_default_options(VNEOpenOptions *opts);
+VNEF_VIDEO_API VNEVideo *vne_video_open_ex(const char *path, const VNEOpenOptions *opts, VNEVideoInfo *out_info);
+
+// Opens a .video container or plain media file that is already in memory
+// (e.g. unpacked from an archive). The bytes are read in place, not copied,
+// and must stay valid until vne_video_close.
+VNEF_VIDEO_API VNEVideo *vne_video_open_memory(const void *data, size_t size, const VNEOpenOptions *opts, VNEVideoInfo *out_info);
+
+// Packs hold many clips in one file (see README). Opening a pack maps it once;
+// entries then open as windows over that mapping without another fopen.
+// Handles opened from a pack stay valid after vne_video_pack_close.
+VNEF_VIDEO_API VNEVideoPack *vne_video_pack_open(const char *path);
+VNEF_VIDEO_API void vne_video_pack_close(VNEVideoPack *pack);
+VNEF_VIDEO_API int vne_video_pack_count(const VNEVideoPack *pack);
+// Returns the entry index for name, or -1 if the pack has no such entry.
+VNEF_VIDEO_API int vne_video_pack_find(const VNEVideoPack *pack, const char *name);
+VNEF_VIDEO_API const char *vne_video_pack_name(const VNEVideoPack *pack, int index);
+// Cached metadata from the pack directory, without opening the entry.
+VNEF_VIDEO_API int vne_video_pack_info(const VNEVideoPack *pack, int index, VNEVideoInfo *out_info);
+VNEF_VIDEO_API VNEVideo *vne_video_pack_open_entry(VNEVideoPack *pack, int index, const VNEOpenOptions *opts, VNEVideoInfo *out_info);
+VNEF_VIDEO_API VNEVideo *vne_video_pack_open_name(VNEVideoPack *pack, const char *name, const VNEOpenOptions *opts, VNEVideoInfo *out_info);
+
+// Switches the handle to another asset with the same open options. Decoders,
+// sws and swr contexts, pools, frames and the AVIO buffer are kept when the new
+// asset is compatible (same codec, size and formats) and rebuilt only where it
+// differs. Async decoding is stopped. Returns v, or NULL after closing it on
+// failure. Frames already handed out stay valid.
+VNEF_VIDEO_API VNEVideo *vne_video_reopen(VNEVideo *v, const char *path, VNEVideoInfo *out_info);
+
+// Opens many assets at once on a pool of threads (<= 0 = one per core, capped
+// at count), e.g. everything the next scene needs. Each handle comes back
+// primed: its first video and audio frames are already decoded and queued, so
+// the first vne_video_next returns without decoding. vne_video_next_into
+// copies a primed frame into dst; vne_video_frame_at_ms drops the queue (the
+// frames are in its cache). opts may be NULL.
+VNEF_VIDEO_API VNEVideoPreload *vne_video_preload_start(const char *const *paths, int count, const VNEOpenOptions *opts, int threads);
+// Never blocks. Returns 1 when the handle is ready, 0 while it is loading and
+// -1 if it failed to open or was already taken.
+VNEF_VIDEO_API int vne_video_preload_poll(VNEVideoPreload *p, int index);
+// Hands over a ready handle (NULL otherwise); the caller closes it as usual.
+VNEF_VIDEO_API VNEVideo *vne_video_preload_take(VNEVideoPreload *p, int index, VNEVideoInfo *out_info);
+// Waits for opens in progress, skips the rest and closes handles never taken.
+VNEF_VIDEO_API void vne_video_preload_free(VNEVideoPreload *p);
+
 VNEF_VIDEO_API void vne_video_close(VNEVideo *v);
 VNEF_VIDEO_API const char *vne_video_last_error(VNEVideo *v);
 
 // Returns which frame was produced. Use pts_ms to schedule playback.
+// Video frames are always width x height as reported by VNEVideoInfo and come
+// from a per-handle pool; release them with vne_video_free_video_frame.
 VNEF_VIDEO_API VNEFrameType vne_video_next(VNEVideo *v, VNEVideoFrame *out_video, VNEAudioFrame *out_audio);
 
+// Like vne_video_next, but converts video straight into a caller-owned buffer
+// (e.g. a mapped upload buffer or an atlas sub-rect). dst must hold
+// info.height rows of dst_stride bytes, with dst_stride >= info.width * 4.
+// The returned out_video->data is dst; do not pass it to vne_video_free_video_frame.
+VNEF_VIDEO_API VNEFrameType vne_video_next_into(VNEVideo *v, uint8_t *dst, int dst_stride, VNEVideoFrame *out_video, VNEAudioFrame *out_audio);
+
+// Planar counterpart of vne_video_next for handles opened with a planar
+// output_format. Release frames with vne_video_free_planar_frame.
+VNEF_VIDEO_API VNEFrameType vne_video_next_planar(VNEVideo *v, VNEPlanarFrame *out_video, VNEAudioFrame *out_audio);
+
+// Per-stream pulls for a render thread and an audio thread running side by
+// side: each call decodes only its own stream, so audio never waits on a video
+// decode or conversion. Packets demuxed for the other stream are parked in a
+// bounded queue; while that queue is full the call returns VNE_FRAME_NONE until
+// the other stream is pulled. The two may run concurrently with each other but
+// not with vne_video_next*, seeking or async start/stop. In async mode they
+// take frames from the worker's queues. next_video is RGBA only.
+VNEF_VIDEO_API VNEFrameType vne_video_next_video(VNEVideo *v, VNEVideoFrame *out_video);
+VNEF_VIDEO_API VNEFrameType vne_video_next_audio(VNEVideo *v, VNEAudioFrame *out_audio);
+
+// Clock-driven playback for RGBA handles: returns the newest frame due at
+// now_ms (media time), or VNE_FRAME_NONE while the next frame is not due yet.
+// Frames already behind the clock are dropped before conversion and counted
+// in out_dropped (may be NULL). While drops keep happening, the decoder skips
+// the loop filter and then non-reference frames until playback catches up.
+// Audio is read with vne_video_next_audio or the audio ring. Until the first
+// vne_video_next_audio call, video does not wait for audio. It drops the
+// oldest parked audio packets, or the queued audio frames in async mode. Once
+// audio has been pulled, video waits when 256 packets are parked and returns
+// VNE_FRAME_NONE until audio catches up. Open with disable_audio for
+// video-only playback. Do not mix with vne_video_next* on the same handle.
+VNEF_VIDEO_API VNEFrameType vne_video_update(VNEVideo *v, int64_t now_ms, VNEVideoFrame *out_video, int *out_dropped);
+
+// Starts decoding ahead on a background thread into bounded queues of up to
+// queue_depth video and queue_depth audio frames (<= 0 picks a default).
+// While async, vne_video_next never blocks: it hands over the oldest ready
+// frame or returns VNE_FRAME_NONE when nothing is decoded yet. Only
+// vne_video_next, the per-stream pulls, vne_video_seek_ms and the free
+// functions may be used while async. Returns 0 on success, -1 on failure.
+VNEF_VIDEO_API int vne_video_start_async(VNEVideo *v, int queue_depth);
+
+// Stops the worker and returns to synchronous decoding. Frames it already
+// queued are still handed out first.
+VNEF_VIDEO_API void vne_video_stop_async(VNEVideo *v);
+
+// A shared decode scheduler for scenes with many live videos: a fixed pool of
+// threads (<= 0 = one per core) decodes ahead for every handle added, always
+// serving the handle whose queued frames run out soonest. A handle added to a
+// scheduler behaves as if vne_video_start_async(v, queue_depth) were called;
+// stop/start_async pause and resume it, and vne_video_close removes it.
+VNEF_VIDEO_API VNEScheduler *vne_scheduler_create(int threads);
+// Returns 0 on success, -1 on failure or if v belongs to another scheduler.
+VNEF_VIDEO_API int vne_scheduler_add(VNEScheduler *s, VNEVideo *v, int queue_depth);
+// Returns v to synchronous decoding; queued frames are still handed out.
+VNEF_VIDEO_API void vne_scheduler_remove(VNEScheduler *s, VNEVideo *v);
+// Stops the workers; handles still registered stay open and turn synchronous.
+VNEF_VIDEO_API void vne_scheduler_destroy(VNEScheduler *s);
+
+// Audio ring mode (audio_ring_ms > 0): audio is resampled straight into a
+// lock-free single-producer/single-consumer ring filled by whatever decodes
+// (vne_video_next*, vne_video_update or the async worker) instead of being returned as
+// VNEAudioFrames. Copies up to nb_samples interleaved sample frames into dst
+// and returns how many were copied. Never blocks or locks, so it can be called
+// from a real-time audio callback (one reader thread). A short read before the
+// end of the stream counts as an underrun.
+VNEF_VIDEO_API int vne_video_read_audio(VNEVideo *v, void *dst, int nb_samples);
+VNEF_VIDEO_API int vne_video_audio_underruns(VNEVideo *v);
+
+// Return pooled frame buffers. Safe to call after vne_video_close.
 VNEF_VIDEO_API void vne_video_free_video_frame(VNEVideoFrame *f);
+VNEF_VIDEO_API void vne_video_free_planar_frame(VNEPlanarFrame *f);
 VNEF_VIDEO_API void vne_video_free_audio_frame(VNEAudioFrame *f);
 
+// Poster frames for galleries and save slots. Only the keyframe at or before
+// time_ms is decoded and converted straight to at most max_w x max_h (aspect
+// kept). out is a pooled RGBA frame; release it with vne_video_free_video_frame.
+// Returns 0 on success, -1 on failure.
+VNEF_VIDEO_API int vne_video_thumbnail(const char *path, int64_t time_ms, int max_w, int max_h, VNEVideoFrame *out);
+
+// count thumbnails evenly spaced over the clip (at the middle of each of count
+// equal segments), taken in one forward pass over a single open. Returns how
+// many were written to out[0..n-1], or -1 if the file cannot be opened.
+VNEF_VIDEO_API int vne_video_thumbnails(const char *path, int count, int max_w, int max_h, VNEVideoFrame *out);
+
+// Random access for scrubbing and rewind on RGBA handles opened with
+// frame_cache_bytes. Returns the frame on screen at target_ms. Converted frames
+// (including ones from normal playback) are kept in a per-handle cache keyed by
+// pts; on a miss the GOP up to the target is decoded once and cached, so
+// stepping back through it is served from memory. Not available while async.
+VNEF_VIDEO_API VNEFrameType vne_video_frame_at_ms(VNEVideo *v, int64_t target_ms, VNEVideoFrame *out_video);
+
+// The frame before the one last returned by frame_at_ms / step_back.
+// Returns VNE_FRAME_NONE at the start of the clip.
+VNEF_VIDEO_API VNEFrameType vne_video_step_back(VNEVideo *v, VNEVideoFrame *out_video);
+
+// Flags for vne_video_seek_ex.
+typedef enum VNESeekFlags {
+    // Decode forward from the keyframe inside the library and return the first
+    // frame at or after the target. Skipped frames are never converted and
+    // skipped audio is never resampled.
+    VNE_SEEK_ACCURATE = 1,
+} VNESeekFlags;
+
 // Seek to a timestamp in milliseconds. Returns 0 on success, -1 on failure.
+// Lands on the keyframe at or before the target.
 VNEF_VIDEO_API int vne_video_seek_ms(VNEVideo *v, int64_t target_ms);
+VNEF_VIDEO_API int vne_video_seek_ex(VNEVideo *v, int64_t target_ms, int flags);
 
 #ifdef __cplusplus
 }
@@ -4,8 +4,20 @@
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
-#if !defined(_WIN32)
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <io.h>
+#else
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+#if !defined(_MSC_VER)
+#include <stdatomic.h>
 #endif
 
 #include <libavformat/avformat.h>
@@ -15,6 +27,8 @@
 #include <libavutil/opt.h>
 #include <libavutil/imgutils.h>
 #include <libavutil/channel_layout.h>
+#include <libavutil/cpu.h>
+#include <libavutil/time.h>
 #include <libswscale/swscale.h>
 #include <libswresample/swresample.h>
 
@@ -28,7 +42,188 @@
 #define VNEF_LOG(...) ((void)0)
 #endif
 
+#if defined(_WIN32)
+typedef CRITICAL_SECTION vne_mutex;
+typedef CONDITION_VARIABLE vne_cond;
+typedef struct vne_thread {
+    HANDLE handle;
+    void (*fn)(void *);
+    void *arg;
+} vne_thread;
+
+static void vne_mutex_init(vne_mutex *m) { InitializeCriticalSection(m); }
+static void vne_mutex_destroy(vne_mutex *m) { DeleteCriticalSection(m); }
+static void vne_mutex_lock(vne_mutex *m) { EnterCriticalSection(m); }
+static void vne_mutex_unlock(vne_mutex *m) { LeaveCriticalSection(m); }
+
+static void vne_cond_init(vne_cond *c) { InitializeConditionVariable(c); }
+static void vne_cond_destroy(vne_cond *c) { (void)c; }
+static void vne_cond_signal(vne_cond *c) { WakeConditionVariable(c); }
+static void vne_cond_broadcast(vne_cond *c) { WakeAllConditionVariable(c); }
+static void vne_cond_wait_ms(vne_cond *c, vne_mutex *m, int ms) { SleepConditionVariableCS(c, m, (DWORD)ms); }
+
+static DWORD WINAPI vne_thread_entry(LPVOID arg) {
+    vne_thread *t = (vne_thread *)arg;
+    t->fn(t->arg);
+    return 0;
+}
+
+static int vne_thread_start(vne_thread *t, void (*fn)(void *), void *arg) {
+    t->fn = fn;
+    t->arg = arg;
+    t->handle = CreateThread(NULL, 0, vne_thread_entry, t, 0, NULL);
+    return t->handle ? 0 : -1;
+}
+
+static void vne_thread_join(vne_thread *t) {
+    WaitForSingleObject(t->handle, INFINITE);
+    CloseHandle(t->handle);
+    t->handle = NULL;
+}
+#else
+typedef pthread_mutex_t vne_mutex;
+typedef pthread_cond_t vne_cond;
+typedef struct vne_thread {
+    pthread_t handle;
+    void (*fn)(void *);
+    void *arg;
+} vne_thread;
+
+static void vne_mutex_init(vne_mutex *m) { pthread_mutex_init(m, NULL); }
+static void vne_mutex_destroy(vne_mutex *m) { pthread_mutex_destroy(m); }
+static void vne_mutex_lock(vne_mutex *m) { pthread_mutex_lock(m); }
+static void vne_mutex_unlock(vne_mutex *m) { pthread_mutex_unlock(m); }
+
+static void vne_cond_init(vne_cond *c) { pthread_cond_init(c, NULL); }
+static void vne_cond_destroy(vne_cond *c) { pthread_cond_destroy(c); }
+static void vne_cond_signal(vne_cond *c) { pthread_cond_signal(c); }
+static void vne_cond_broadcast(vne_cond *c) { pthread_cond_broadcast(c); }
+
+static void vne_cond_wait_ms(vne_cond *c, vne_mutex *m, int ms) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += ms / 1000;
+    ts.tv_nsec += (long)(ms % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec += 1;
+        ts.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(c, m, &ts);
+}
+
+static void *vne_thread_entry(void *arg) {
+    vne_thread *t = (vne_thread *)arg;
+    t->fn(t->arg);
+    return NULL;
+}
+
+static int vne_thread_start(vne_thread *t, void (*fn)(void *), void *arg) {
+    t->fn = fn;
+    t->arg = arg;
+    return pthread_create(&t->handle, NULL, vne_thread_entry, t) == 0 ? 0 : -1;
+}
+
+static void vne_thread_join(vne_thread *t) {
+    pthread_join(t->handle, NULL);
+}
+#endif
+
+#if defined(_MSC_VER)
+typedef volatile LONG vne_atomic_int;
+static int vne_atomic_load(vne_atomic_int *a) { return (int)InterlockedCompareExchange(a, 0, 0); }
+static void vne_atomic_store(vne_atomic_int *a, int x) { InterlockedExchange(a, (LONG)x); }
+static int vne_atomic_add(vne_atomic_int *a, int x) { return (int)InterlockedExchangeAdd(a, (LONG)x) + x; }
+#else
+typedef atomic_int vne_atomic_int;
+static int vne_atomic_load(vne_atomic_int *a) { return atomic_load_explicit(a, memory_order_acquire); }
+static void vne_atomic_store(vne_atomic_int *a, int x) { atomic_store_explicit(a, x, memory_order_release); }
+static int vne_atomic_add(vne_atomic_int *a, int x) { return atomic_fetch_add_explicit(a, x, memory_order_acq_rel) + x; }
+#endif
+
+// Buffers handed to the caller carry this header in front of their data so
+// they can find their way back to the pool without the owning handle.
+#define VNE_POOL_HEADER_SIZE 64
+
+typedef struct VNEBufferPool VNEBufferPool;
+
+typedef struct VNEPoolBuffer {
+    VNEBufferPool *pool;
+    struct VNEPoolBuffer *next;
+    size_t size;
+    vne_atomic_int refs; // the caller's, plus one while the frame cache holds it
+} VNEPoolBuffer;
+
+struct VNEBufferPool {
+    vne_mutex lock;
+    int refs;        // owner + buffers currently out with the caller
+    int closed;      // owner is gone, released buffers are freed
+    size_t buf_size; // current size class, buffers of other sizes are dropped
+    VNEPoolBuffer *free_list;
+};
+
+// Where the next decoded video frame goes: an RGBA frame (pooled, or converted
+// into the caller's dst) or a planar frame.
+typedef struct VNEVideoTarget {
+    VNEVideoFrame *rgba;
+    VNEPlanarFrame *planar;
+    uint8_t *dst;
+    int dst_stride;
+} VNEVideoTarget;
+
+// Decoded frames waiting for the consumer in async mode. Single producer (the
+// worker) and single consumer; head and tail are free-running counters.
+typedef struct VNEFrameSlot {
+    VNEVideoFrame video;
+    VNEPlanarFrame planar;
+    VNEAudioFrame audio;
+} VNEFrameSlot;
+
+typedef struct VNEFrameRing {
+    VNEFrameSlot *slots;
+    unsigned mask;  // slot count - 1, slot count is a power of two
+    unsigned depth; // max frames queued
+    vne_atomic_int head;
+    vne_atomic_int tail;
+} VNEFrameRing;
+
+// Audio ring mode: the resampler writes interleaved samples straight in, the
+// audio callback reads them out. Single producer (whoever decodes) and single
+// consumer; positions are free-running sample counters.
+typedef struct VNESampleRing {
+    uint8_t *data;
+    unsigned capacity;     // samples per channel, a power of two
+    unsigned mask;
+    int frame_bytes;       // channels * bytes per sample
+    vne_atomic_int head;   // consumer position
+    vne_atomic_int tail;   // producer position
+    vne_atomic_int flush;  // seek: samples before this are stale
+    vne_atomic_int ended;  // the decoder is drained, short reads are not underruns
+    vne_atomic_int underruns;
+} VNESampleRing;
+
+// Decoded-frame cache (frame_cache_bytes > 0): converted RGBA frames keyed by
+// pts, shared with the caller through pool buffer refs. next_pts_ms links a
+// frame to the one decoded right after it, so an entry answers any target in
+// [pts_ms, next_pts_ms).
+typedef struct VNECachedFrame {
+    int64_t pts_ms;
+    int64_t next_pts_ms; // pts_ms + 1 until the following frame is seen
+    uint8_t *data;
+    uint64_t used;       // LRU stamp
+} VNECachedFrame;
+
+// Packets demuxed for one stream while the other stream's consumer reads
+// ahead (vne_video_next_video / vne_video_next_audio). Guarded by demux_lock.
+#define VNE_PACKET_QUEUE_SIZE 256
+
+typedef struct VNEPacketQueue {
+    AVPacket *pkts[VNE_PACKET_QUEUE_SIZE];
+    int head;
+    int count;
+} VNEPacketQueue;
+
 struct VNEVideo {
+    VNEOpenOptions opts;
     AVFormatContext *fmt;
     AVCodecContext *vdec;
     AVCodecContext *adec;
@@ -44,18 +239,101 @@ struct VNEVideo {
     int sws_w;
     int sws_h;
     enum AVPixelFormat sws_fmt;
+    int out_w;
+    int out_h;
+    int src_w; // coded size of the open video stream
+    int src_h;
+    int fit_w; // thumbnails: output fits this box (overrides the target size)
+    int fit_h;
+    enum AVPixelFormat out_fmt;
+    int sws_threads;
+    AVFrame *sws_dst; // wraps the output buffer for threaded sws_scale_frame
+    VNEBufferPool *vpool;
     enum AVSampleFormat out_sample_fmt;
+    int out_sample_rate;
+    int out_channels;
+    int out_bytes_per_sample;
+    int audio_max_samples; // output capacity of one pooled audio buffer
+    VNEBufferPool *apool;
+    VNESampleRing sring;
     AVIOContext *avio;
+    unsigned char *avio_buf; // kept from the previous asset by vne_video_reopen
+    int avio_buf_size;
     struct VNEVideoIO *io;
+    struct VNEKeyframe *kindex; // from a v2 .video container, handed to the demuxer
+    int kindex_count;
+    struct VNEStreamCache *cache; // cached stream metadata, dropped after open
     int eof;
+    int64_t video_skip_ms; // accurate seek: drop frames before this pts
+    int64_t audio_skip_ms;
+
+    VNEPacketQueue vqueue;
+    VNEPacketQueue aqueue;
+    AVPacket *vpkt; // per-stream read packets, one per pulling thread
+    AVPacket *apkt;
+    int vflushed;   // decoder was sent its end-of-stream flush
+    int aflushed;
+    vne_atomic_int audio_pulled; // vne_video_next_audio has been called
+    AVFrame *vnext; // vne_video_update: decoded frame not due yet
+    AVFrame *vdue;  // vne_video_update: newest due frame so far
+    int vnext_valid;
+    VNECachedFrame *fcache;
+    int fcache_count;
+    int fcache_cap;
+    size_t fcache_bytes;
+    uint64_t fcache_clock;
+    int64_t fcache_prev_pts; // frame converted last, AV_NOPTS_VALUE after a seek
+    int64_t scrub_pts_ms;    // frame handed out last by frame_at_ms / step_back
+    AVFrame *vprev;          // skip_repeats: source of the frame converted last
+    uint8_t *last_out;       // skip_repeats: where it was converted to
+    int last_out_stride;
+    int last_out_pooled;     // last_out is a pool buffer we hold a ref on
+    int64_t loop_end_ms;    // loop mode: end of the clip's packets, from the first pass
+    int64_t loop_offset_ms; // added to every timestamp in the current pass
+    int loop_count;
+    int lag_level;  // decoder shortcuts taken while playback lags (0-3)
+    int lag_calls;  // > 0: updates in a row that dropped, < 0: that did not
+    vne_mutex demux_lock;
+    vne_mutex video_lock;
+    vne_mutex audio_lock;
+
+    VNEFrameRing vring;
+    VNEFrameRing aring;
+    int async_running;          // worker thread or scheduler decodes ahead
+    int async_sync_init;
+    vne_thread async_thread;
+    vne_mutex async_lock;
+    vne_cond async_cond;
+    vne_atomic_int async_quit;
+    VNEScheduler *sched;        // shared workers decode instead of async_thread
+    vne_atomic_int sched_busy;  // a worker is decoding it
+    int64_t sched_tail_ms;      // pts of the newest queued frame
+    int64_t sched_retry_ms;     // nothing to decode until then
+    vne_atomic_int async_waiting;
+    vne_atomic_int async_state; // VNE_FRAME_NONE while decoding, EOF or ERROR once the worker is done
+
     char last_error[256];
 };
 
+// Read-only mapping of a whole file. Reference counted so several handles can
+// read from one mapping.
+typedef struct VNEFileMap {
+    const uint8_t *data;
+    int64_t size;
+    vne_atomic_int refs;
+#if defined(_WIN32)
+    HANDLE mapping;
+#endif
+} VNEFileMap;
+
 typedef struct VNEVideoIO {
     FILE *fp;
+    VNEFileMap *map;     // owned reference when reading from a file mapping
+    const uint8_t *base; // start of the mapped or caller memory; reads skip fp
     int64_t data_offset;
     int64_t data_size;
     int64_t pos;
+    int64_t file_pos; // where fp currently is, to skip redundant seeks
 } VNEVideoIO;
 
 static int64_t vne_file_tell(FILE *fp) {
@@ -83,60 +361,368 @@ static int64_t vne_file_size(FILE *fp) {
     return size;
 }
 
-static int vne_video_probe_header(FILE *fp, int64_t *out_size) {
-    uint8_t hdr[16];
+// One keyframe index entry from a v2 .video container: pts and the byte
+// offset of the cluster that starts with it, relative to the WebM payload.
+typedef struct VNEKeyframe {
+    int64_t pts_ms;
+    int64_t offset;
+} VNEKeyframe;
 
-    if (vne_file_seek(fp, 0, SEEK_SET) != 0) {
-        return -1;
+// Codec parameters cached by the build tool (VPAR / APAR sections).
+typedef struct VNECodecCache {
+    int present;
+    char codec[32];
+    char format[32]; // pixel or sample format name
+    int width;
+    int height;
+    int sample_rate;
+    int channels;
+    uint64_t channel_mask;
+    int frame_size;
+    uint8_t *extradata;
+    int extradata_size;
+} VNECodecCache;
+
+// Stream metadata from a v2 .video header. With SINF present the open path
+// trusts it and skips avformat_find_stream_info.
+typedef struct VNEStreamCache {
+    int has_info;
+    VNEVideoInfo info;
+    VNECodecCache video;
+    VNECodecCache audio;
+} VNEStreamCache;
+
+typedef struct VNEContainer {
+    int64_t data_offset;
+    int64_t data_size;
+    VNEKeyframe *index;
+    int index_count;
+    VNEStreamCache *cache;
+} VNEContainer;
+
+#define VNE_HEADER_SIZE 16
+#define VNE_MAX_EXT_SIZE (64 * 1024 * 1024)
+
+static uint32_t rd_le32(const uint8_t *p) {
+    return (uint32_t)p[0]
+        | ((uint32_t)p[1] << 8)
+        | ((uint32_t)p[2] << 16)
+        | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t rd_le64(const uint8_t *p) {
+    return (uint64_t)rd_le32(p) | ((uint64_t)rd_le32(p + 4) << 32);
+}
+
+static void stream_cache_free(VNEStreamCache *cache) {
+    if (!cache) return;
+    av_free(cache->video.extradata);
+    av_free(cache->audio.extradata);
+    free(cache);
+}
+
+static void container_free(VNEContainer *c) {
+    free(c->index);
+    c->index = NULL;
+    c->index_count = 0;
+    stream_cache_free(c->cache);
+    c->cache = NULL;
+}
+
+// Bounds-checked cursor over one section payload. Any overrun sets err.
+typedef struct VNEReader {
+    const uint8_t *p;
+    uint32_t len;
+    uint32_t off;
+    int err;
+} VNEReader;
+
+static const uint8_t *rd_take(VNEReader *r, uint32_t n) {
+    if (r->err || r->len - r->off < n) {
+        r->err = 1;
+        return NULL;
     }
+    const uint8_t *p = r->p + r->off;
+    r->off += n;
+    return p;
+}
 
-    size_t n = fread(hdr, 1, sizeof(hdr), fp);
-    if (n != sizeof(hdr)) {
+static uint32_t rd_u32(VNEReader *r) {
+    const uint8_t *p = rd_take(r, 4);
+    return p ? rd_le32(p) : 0;
+}
+
+static uint64_t rd_u64(VNEReader *r) {
+    const uint8_t *p = rd_take(r, 8);
+    return p ? rd_le64(p) : 0;
+}
+
+static void rd_str(VNEReader *r, char *dst, size_t cap) {
+    const uint8_t *lp = rd_take(r, 2);
+    uint32_t n = lp ? ((uint32_t)lp[0] | ((uint32_t)lp[1] << 8)) : 0;
+    const uint8_t *p = rd_take(r, n);
+    if (!p || n >= cap) {
+        r->err = 1;
+        dst[0] = '\0';
+        return;
+    }
+    memcpy(dst, p, n);
+    dst[n] = '\0';
+}
+
+static void rd_info(VNEReader *r, VNEVideoInfo *info) {
+    info->width = (int)rd_u32(r);
+    info->height = (int)rd_u32(r);
+    info->fps_num = (int)rd_u32(r);
+    info->fps_den = (int)rd_u32(r);
+    info->duration_ms = (int64_t)rd_u64(r);
+    info->has_audio = (int)rd_u32(r);
+    info->sample_rate = (int)rd_u32(r);
+    info->channels = (int)rd_u32(r);
+}
+
+static void rd_extradata(VNEReader *r, VNECodecCache *cc) {
+    uint32_t n = rd_u32(r);
+    const uint8_t *p = rd_take(r, n);
+    if (!p || n == 0) return;
+    cc->extradata = (uint8_t *)av_mallocz((size_t)n + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (!cc->extradata) {
+        r->err = 1;
+        return;
+    }
+    memcpy(cc->extradata, p, n);
+    cc->extradata_size = (int)n;
+}
+
+static int parse_stream_section(const uint8_t *tag, const uint8_t *p, uint32_t len, VNEStreamCache *cache) {
+    VNEReader r = { p, len, 0, 0 };
+
+    if (memcmp(tag, "SINF", 4) == 0) {
+        rd_info(&r, &cache->info);
+        cache->has_info = !r.err;
+    } else if (memcmp(tag, "VPAR", 4) == 0) {
+        VNECodecCache *cc = &cache->video;
+        rd_str(&r, cc->codec, sizeof(cc->codec));
+        rd_str(&r, cc->format, sizeof(cc->format));
+        cc->width = (int)rd_u32(&r);
+        cc->height = (int)rd_u32(&r);
+        rd_extradata(&r, cc);
+        cc->present = !r.err;
+    } else if (memcmp(tag, "APAR", 4) == 0) {
+        VNECodecCache *cc = &cache->audio;
+        rd_str(&r, cc->codec, sizeof(cc->codec));
+        rd_str(&r, cc->format, sizeof(cc->format));
+        cc->sample_rate = (int)rd_u32(&r);
+        cc->channels = (int)rd_u32(&r);
+        cc->channel_mask = rd_u64(&r);
+        cc->frame_size = (int)rd_u32(&r);
+        rd_extradata(&r, cc);
+        cc->present = !r.err;
+    }
+    return r.err ? -1 : 0;
+}
+
+static int parse_keyframe_index(const uint8_t *p, uint32_t len, VNEContainer *c) {
+    if (len < 4) return -1;
+    uint32_t count = rd_le32(p);
+    if ((uint64_t)count * 16 > len - 4) return -1;
+    if (count == 0) return 0;
+
+    c->index = (VNEKeyframe *)malloc((size_t)count * sizeof(VNEKeyframe));
+    if (!c->index) return -1;
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t *e = p + 4 + (size_t)i * 16;
+        c->index[i].pts_ms = (int64_t)rd_le64(e);
+        c->index[i].offset = (int64_t)rd_le64(e + 8);
+    }
+    c->index_count = (int)count;
+    return 0;
+}
+
+// v2 extension area: a run of sections, each a 4-byte tag, a uint32 length
+// and the payload. Unknown tags are skipped so newer writers stay readable.
+static int parse_sections(const uint8_t *p, uint32_t size, VNEContainer *c) {
+    uint32_t off = 0;
+    while (size - off >= 8) {
+        const uint8_t *tag = p + off;
+        uint32_t len = rd_le32(p + off + 4);
+        off += 8;
+        if (len > size - off) return -1;
+
+        if (memcmp(tag, "KIDX", 4) == 0) {
+            if (c->index || parse_keyframe_index(p + off, len, c) < 0) return -1;
+        } else if (memcmp(tag, "SINF", 4) == 0 || memcmp(tag, "VPAR", 4) == 0 || memcmp(tag, "APAR", 4) == 0) {
+            if (!c->cache) {
+                c->cache = (VNEStreamCache *)calloc(1, sizeof(VNEStreamCache));
+                if (!c->cache) return -1;
+            }
+            if (parse_stream_section(tag, p + off, len, c->cache) < 0) return -1;
+        }
+        off += len;
+    }
+    return 0;
+}
+
+// Parses a .video header from the first avail bytes of a total-byte file.
+// Returns 1 for a .video container (filling c), 0 for anything else and -1
+// for a broken or unsupported container.
+static int parse_container(const uint8_t *p, size_t avail, int64_t total, VNEContainer *c) {
+    memset(c, 0, sizeof(*c));
+
+    if (avail < VNE_HEADER_SIZE) {
         return 0; // too small or not a .video container
     }
 
-    if (memcmp(hdr, "VID0", 4) != 0) {
+    if (memcmp(p, "VID0", 4) != 0) {
         return 0; // not our container
     }
 
-    uint32_t version = (uint32_t)hdr[4]
-        | ((uint32_t)hdr[5] << 8)
-        | ((uint32_t)hdr[6] << 16)
-        | ((uint32_t)hdr[7] << 24);
-
-    if (version != 1) {
+    uint32_t version = rd_le32(p + 4);
+    if (version != 1 && version != 2) {
         return -1; // unsupported version
     }
 
-    uint64_t size = (uint64_t)hdr[8]
-        | ((uint64_t)hdr[9] << 8)
-        | ((uint64_t)hdr[10] << 16)
-        | ((uint64_t)hdr[11] << 24)
-        | ((uint64_t)hdr[12] << 32)
-        | ((uint64_t)hdr[13] << 40)
-        | ((uint64_t)hdr[14] << 48)
-        | ((uint64_t)hdr[15] << 56);
+    uint64_t size = rd_le64(p + 8);
+    int64_t data_offset = VNE_HEADER_SIZE;
 
-    int64_t total = vne_file_size(fp);
-    if (total < 0 || total < 16) {
+    if (version >= 2) {
+        if (avail < VNE_HEADER_SIZE + 4) {
+            return -1;
+        }
+        uint32_t ext_size = rd_le32(p + VNE_HEADER_SIZE);
+        if (ext_size > VNE_MAX_EXT_SIZE || avail - (VNE_HEADER_SIZE + 4) < ext_size) {
+            return -1;
+        }
+        data_offset = VNE_HEADER_SIZE + 4 + (int64_t)ext_size;
+
+        if (parse_sections(p + VNE_HEADER_SIZE + 4, ext_size, c) < 0) {
+            container_free(c);
+            return -1;
+        }
+    }
+
+    if (total < data_offset) {
+        container_free(c);
         return -1;
     }
 
     if (size == 0) {
-        size = (uint64_t)(total - 16);
+        size = (uint64_t)(total - data_offset);
     }
 
-    if (size > (uint64_t)(total - 16)) {
+    if (size > (uint64_t)(total - data_offset)) {
+        container_free(c);
         return -1;
     }
 
-    *out_size = (int64_t)size;
+    c->data_offset = data_offset;
+    c->data_size = (int64_t)size;
     return 1;
 }
 
+static int vne_video_probe_header(FILE *fp, VNEContainer *c) {
+    uint8_t hdr[VNE_HEADER_SIZE + 4];
+
+    memset(c, 0, sizeof(*c));
+
+    if (vne_file_seek(fp, 0, SEEK_SET) != 0) {
+        return -1;
+    }
+
+    size_t n = fread(hdr, 1, sizeof(hdr), fp);
+    if (n < VNE_HEADER_SIZE || memcmp(hdr, "VID0", 4) != 0) {
+        return 0;
+    }
+
+    int64_t total = vne_file_size(fp);
+    if (total < 0) {
+        return -1;
+    }
+
+    if (rd_le32(hdr + 4) < 2 || n < sizeof(hdr)) {
+        return parse_container(hdr, n, total, c);
+    }
+
+    // v2: pull in the extension area so the whole header parses in one go.
+    uint32_t ext_size = rd_le32(hdr + VNE_HEADER_SIZE);
+    if (ext_size > VNE_MAX_EXT_SIZE) {
+        return -1;
+    }
+    uint8_t *buf = (uint8_t *)malloc(sizeof(hdr) + ext_size);
+    if (!buf) return -1;
+    memcpy(buf, hdr, sizeof(hdr));
+    n = sizeof(hdr) + fread(buf + sizeof(hdr), 1, ext_size, fp);
+
+    int ret = parse_container(buf, n, total, c);
+    free(buf);
+    return ret;
+}
+
+#if !defined(_WIN32)
+static void vne_map_advise(VNEFileMap *m, int64_t offset, int64_t len, int advice) {
+    long page = sysconf(_SC_PAGESIZE);
+    if (page <= 0 || offset >= m->size) return;
+    if (len > m->size - offset) len = m->size - offset;
+
+    int64_t start = offset - offset % page;
+    madvise((void *)(m->data + start), (size_t)(len + (offset - start)), advice);
+}
+#endif
+
+// Maps the whole file behind fp. Returns NULL when mapping is not possible
+// (empty file, unsupported filesystem); callers then fall back to stdio.
+static VNEFileMap *vne_map_open(FILE *fp) {
+    int64_t size = vne_file_size(fp);
+    if (size <= 0 || (uint64_t)size > (uint64_t)SIZE_MAX) return NULL;
+
+    VNEFileMap *m = (VNEFileMap *)calloc(1, sizeof(VNEFileMap));
+    if (!m) return NULL;
+
+#if defined(_WIN32)
+    HANDLE file = (HANDLE)_get_osfhandle(_fileno(fp));
+    if (file == INVALID_HANDLE_VALUE) {
+        free(m);
+        return NULL;
+    }
+    m->mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!m->mapping) {
+        free(m);
+        return NULL;
+    }
+    m->data = (const uint8_t *)MapViewOfFile(m->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!m->data) {
+        CloseHandle(m->mapping);
+        free(m);
+        return NULL;
+    }
+#else
+    void *p = mmap(NULL, (size_t)size, PROT_READ, MAP_SHARED, fileno(fp), 0);
+    if (p == MAP_FAILED) {
+        free(m);
+        return NULL;
+    }
+    m->data = (const uint8_t *)p;
+#endif
+
+    m->size = size;
+    vne_atomic_store(&m->refs, 1);
+    return m;
+}
+
+static void vne_map_unref(VNEFileMap *m) {
+    if (!m || vne_atomic_add(&m->refs, -1) > 0) return;
+#if defined(_WIN32)
+    UnmapViewOfFile((LPCVOID)m->data);
+    CloseHandle(m->mapping);
+#else
+    munmap((void *)m->data, (size_t)m->size);
+#endif
+    free(m);
+}
+
 static int vne_video_read(void *opaque, uint8_t *buf, int buf_size) {
     VNEVideoIO *io = (VNEVideoIO *)opaque;
-    if (!io || !io->fp) return AVERROR_EOF;
+    if (!io || (!io->fp && !io->base)) return AVERROR_EOF;
 
     int64_t remaining = io->data_size - io->pos;
     if (remaining <= 0) return AVERROR_EOF;
@@ -147,22 +733,36 @@ static int vne_video_read(void *opaque, uint8_t *buf, int buf_size) {
     }
 
     int64_t target = io->data_offset + io->pos;
-    if (vne_file_seek(io->fp, target, SEEK_SET) != 0) {
-        return AVERROR(EIO);
+
+    if (io->base) {
+        memcpy(buf, io->base + target, (size_t)to_read);
+        io->pos += to_read;
+        return to_read;
+    }
+
+    // Sequential reads (the common case) continue where fread left off.
+    if (io->file_pos != target) {
+        if (vne_file_seek(io->fp, target, SEEK_SET) != 0) {
+            io->file_pos = -1;
+            return AVERROR(EIO);
+        }
+        io->file_pos = target;
     }
 
     size_t got = fread(buf, 1, (size_t)to_read, io->fp);
     if (got == 0) {
+        io->file_pos = -1;
         return AVERROR_EOF;
     }
 
     io->pos += (int64_t)got;
+    io->file_pos += (int64_t)got;
     return (int)got;
 }
 
 static int64_t vne_video_seek(void *opaque, int64_t offset, int whence) {
     VNEVideoIO *io = (VNEVideoIO *)opaque;
-    if (!io || !io->fp) return -1;
+    if (!io || (!io->fp && !io->base)) return -1;
 
     if (whence == AVSEEK_SIZE) {
         return io->data_size;
@@ -182,6 +782,13 @@ static int64_t vne_video_seek(void *opaque, int64_t offset, int whence) {
     if (new_pos < 0) return -1;
     if (new_pos > io->data_size) new_pos = io->data_size;
 
+#if !defined(_WIN32)
+    // Start paging in the seek target before the demuxer asks for it.
+    if (io->map && new_pos != io->pos) {
+        vne_map_advise(io->map, io->data_offset + new_pos, 1024 * 1024, MADV_WILLNEED);
+    }
+#endif
+
     io->pos = new_pos;
     return io->pos;
 }
@@ -199,117 +806,489 @@ static void set_ff_error(VNEVideo *v, int err, const char *context) {
     set_error(v, msg);
 }
 
-static int64_t pts_to_ms(AVStream *st, int64_t pts) {
-    if (!st || pts == AV_NOPTS_VALUE) return -1;
-    AVRational tb = st->time_base;
-    return av_rescale_q(pts, tb, (AVRational){1, 1000});
+static VNEBufferPool *vne_pool_create(void) {
+    VNEBufferPool *pool = (VNEBufferPool *)calloc(1, sizeof(VNEBufferPool));
+    if (!pool) return NULL;
+    vne_mutex_init(&pool->lock);
+    pool->refs = 1;
+    return pool;
 }
 
-static int init_video_decoder(VNEVideo *v) {
-    int idx = av_find_best_stream(v->fmt, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
-    if (idx < 0) {
-        set_error(v, "no video stream found");
-        return -1;
+static void vne_pool_free_list(VNEPoolBuffer *b) {
+    while (b) {
+        VNEPoolBuffer *next = b->next;
+        av_free(b);
+        b = next;
     }
-    v->vstream_index = idx;
-    v->vstream = v->fmt->streams[idx];
+}
 
-    AVCodecParameters *par = v->vstream->codecpar;
-    const AVCodec *codec = avcodec_find_decoder(par->codec_id);
-    if (!codec) {
-        set_error(v, "video decoder not found");
-        return -1;
+static void vne_pool_unref_locked(VNEBufferPool *pool) {
+    int refs = --pool->refs;
+    vne_mutex_unlock(&pool->lock);
+    if (refs == 0) {
+        vne_mutex_destroy(&pool->lock);
+        free(pool);
     }
+}
 
-    v->vdec = avcodec_alloc_context3(codec);
-    if (!v->vdec) {
-        set_error(v, "failed to alloc video codec context");
-        return -1;
-    }
+// Returns a buffer with at least size bytes. Buffers of the current size class
+// are recycled; a different size drops the cached ones and starts a new class.
+static uint8_t *vne_pool_get(VNEBufferPool *pool, size_t size) {
+    VNEPoolBuffer *b = NULL;
+    VNEPoolBuffer *stale = NULL;
 
-    if (avcodec_parameters_to_context(v->vdec, par) < 0) {
-        set_error(v, "failed to copy video codec parameters");
-        return -1;
+    vne_mutex_lock(&pool->lock);
+    if (size != pool->buf_size) {
+        stale = pool->free_list;
+        pool->free_list = NULL;
+        pool->buf_size = size;
+    } else if (pool->free_list) {
+        b = pool->free_list;
+        pool->free_list = b->next;
     }
+    pool->refs++;
+    vne_mutex_unlock(&pool->lock);
 
-    if (avcodec_open2(v->vdec, codec, NULL) < 0) {
-        set_error(v, "failed to open video decoder");
-        return -1;
+    vne_pool_free_list(stale);
+
+    if (!b) {
+        b = (VNEPoolBuffer *)av_malloc(VNE_POOL_HEADER_SIZE + size);
+        if (!b) {
+            vne_mutex_lock(&pool->lock);
+            vne_pool_unref_locked(pool);
+            return NULL;
+        }
+        b->pool = pool;
+        b->size = size;
     }
+    b->next = NULL;
+    vne_atomic_store(&b->refs, 1);
+    return (uint8_t *)b + VNE_POOL_HEADER_SIZE;
+}
 
-    v->sws = sws_getContext(
-        v->vdec->width,
-        v->vdec->height,
-        v->vdec->pix_fmt,
-        v->vdec->width,
-        v->vdec->height,
-        AV_PIX_FMT_RGBA,
-        SWS_BILINEAR,
-        NULL,
-        NULL,
-        NULL
-    );
-    if (!v->sws) {
-        set_error(v, "failed to create sws context");
-        return -1;
+static void vne_pool_ref(uint8_t *data) {
+    VNEPoolBuffer *b = (VNEPoolBuffer *)(data - VNE_POOL_HEADER_SIZE);
+    vne_atomic_add(&b->refs, 1);
+}
+
+static void vne_pool_release(uint8_t *data) {
+    if (!data) return;
+    VNEPoolBuffer *b = (VNEPoolBuffer *)(data - VNE_POOL_HEADER_SIZE);
+    if (vne_atomic_add(&b->refs, -1) > 0) return;
+    VNEBufferPool *pool = b->pool;
+
+    vne_mutex_lock(&pool->lock);
+    if (!pool->closed && b->size == pool->buf_size) {
+        b->next = pool->free_list;
+        pool->free_list = b;
+        b = NULL;
     }
-    v->sws_w = v->vdec->width;
-    v->sws_h = v->vdec->height;
-    v->sws_fmt = v->vdec->pix_fmt;
+    vne_pool_unref_locked(pool);
 
-    return 0;
+    if (b) av_free(b);
 }
 
-static int init_audio_decoder(VNEVideo *v) {
-    int idx = av_find_best_stream(v->fmt, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
-    if (idx < 0) {
-        v->astream_index = -1;
-        v->astream = NULL;
-        return 0; // audio is optional
+static void vne_pool_close(VNEBufferPool *pool) {
+    if (!pool) return;
+    vne_mutex_lock(&pool->lock);
+    VNEPoolBuffer *list = pool->free_list;
+    pool->free_list = NULL;
+    pool->closed = 1;
+    vne_pool_unref_locked(pool);
+    vne_pool_free_list(list);
+}
+
+static int64_t pts_to_ms(AVStream *st, int64_t pts) {
+    if (!st || pts == AV_NOPTS_VALUE) return -1;
+    AVRational tb = st->time_base;
+    return av_rescale_q(pts, tb, (AVRational){1, 1000});
+}
+
+// Seeds the demuxer's seek index with the container's keyframe table so
+// seeks jump straight to the right cluster even when WebM cues are missing.
+static void install_keyframe_index(VNEVideo *v) {
+    if (!v->kindex || !v->vstream) return;
+
+    for (int i = 0; i < v->kindex_count; i++) {
+        int64_t ts = av_rescale_q(v->kindex[i].pts_ms, (AVRational){1, 1000}, v->vstream->time_base);
+        av_add_index_entry(v->vstream, v->kindex[i].offset, ts, 0, 0, AVINDEX_KEYFRAME);
     }
 
-    v->astream_index = idx;
-    v->astream = v->fmt->streams[idx];
+    free(v->kindex);
+    v->kindex = NULL;
+    v->kindex_count = 0;
+}
 
-    AVCodecParameters *par = v->astream->codecpar;
-    const AVCodec *codec = avcodec_find_decoder(par->codec_id);
-    if (!codec) {
-        char msg[256];
-        snprintf(msg, sizeof(msg), "audio decoder not found for codec_id %d", par->codec_id);
-        set_error(v, msg);
-        return -1;
+static void apply_threading(AVCodecContext *ctx, int threads, int type) {
+    ctx->thread_count = threads > 0 ? threads : 0; // 0 lets FFmpeg pick per core
+    if (type == VNE_THREAD_AUTO) {
+        ctx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+    } else {
+        ctx->thread_type = 0;
+        if (type & VNE_THREAD_FRAME) ctx->thread_type |= FF_THREAD_FRAME;
+        if (type & VNE_THREAD_SLICE) ctx->thread_type |= FF_THREAD_SLICE;
     }
+}
 
-    v->adec = avcodec_alloc_context3(codec);
-    if (!v->adec) {
-        set_error(v, "failed to alloc audio codec context (out of memory)");
-        return -1;
+#define VNE_MAX_AUDIO_CHANNELS 64 // swr's own limit
+
+static enum AVSampleFormat output_sample_fmt(int format) {
+    switch (format) {
+    case VNE_SAMPLE_F32:  return AV_SAMPLE_FMT_FLT;
+    case VNE_SAMPLE_S16P: return AV_SAMPLE_FMT_S16P;
+    case VNE_SAMPLE_F32P: return AV_SAMPLE_FMT_FLTP;
+    default:              return AV_SAMPLE_FMT_S16;
     }
+}
 
-    int ret = avcodec_parameters_to_context(v->adec, par);
-    if (ret < 0) {
-        set_ff_error(v, ret, "failed to copy audio codec parameters");
-        return -1;
+static enum AVPixelFormat output_pix_fmt(int format) {
+    switch (format) {
+    case VNE_PIXEL_I420: return AV_PIX_FMT_YUV420P;
+    case VNE_PIXEL_NV12: return AV_PIX_FMT_NV12;
+    case VNE_PIXEL_P010: return AV_PIX_FMT_P010LE;
+    default:             return AV_PIX_FMT_RGBA;
     }
+}
 
-    ret = avcodec_open2(v->adec, codec, NULL);
-    if (ret < 0) {
-        set_ff_error(v, ret, "failed to open audio decoder");
-        return -1;
+static int scale_flags(int filter) {
+    switch (filter) {
+    case VNE_SCALE_FAST_BILINEAR: return SWS_FAST_BILINEAR;
+    case VNE_SCALE_BICUBIC:       return SWS_BICUBIC;
+    case VNE_SCALE_AREA:          return SWS_AREA;
+    case VNE_SCALE_LANCZOS:       return SWS_LANCZOS;
+    case VNE_SCALE_POINT:         return SWS_POINT;
+    default:                      return SWS_BILINEAR;
     }
+}
 
-    AVChannelLayout in_layout = {0};
-    int ch = v->adec->ch_layout.nb_channels > 0 ? v->adec->ch_layout.nb_channels : (v->adec->channels > 0 ? v->adec->channels : 2);
-    av_channel_layout_default(&in_layout, ch);
+// Resolves target_width/target_height against the source size. A zero on one
+// side keeps the aspect ratio; zero on both keeps the source size.
+static void compute_output_size(VNEVideo *v, int src_w, int src_h) {
+    int tw = v->opts.target_width;
+    int th = v->opts.target_height;
 
-    AVChannelLayout out_layout = {0};
-    av_channel_layout_default(&out_layout, ch);
+    if (v->fit_w > 0 && v->fit_h > 0 && src_w > 0 && src_h > 0) {
+        // Thumbnails: fit inside the box keeping the aspect, never upscale.
+        tw = src_w;
+        th = src_h;
+        if (tw > v->fit_w) {
+            th = (int)av_rescale(th, v->fit_w, tw);
+            tw = v->fit_w;
+        }
+        if (th > v->fit_h) {
+            tw = (int)av_rescale(tw, v->fit_h, th);
+            th = v->fit_h;
+        }
+    } else if (tw <= 0 && th <= 0) {
+        tw = src_w;
+        th = src_h;
+    } else if (tw <= 0) {
+        tw = (int)av_rescale(src_w, th, src_h);
+    } else if (th <= 0) {
+        th = (int)av_rescale(src_h, tw, src_w);
+    }
 
-    ret = swr_alloc_set_opts2(
-        &v->swr,
+    v->out_w = tw > 0 ? tw : 1;
+    v->out_h = th > 0 ? th : 1;
+}
+
+// Largest decoder lowres level whose output still covers the target size.
+static int pick_lowres(const AVCodec *codec, int src_w, int src_h, int out_w, int out_h) {
+    int level = 0;
+    while (level < codec->max_lowres
+        && ((src_w + (1 << (level + 1)) - 1) >> (level + 1)) >= out_w
+        && ((src_h + (1 << (level + 1)) - 1) >> (level + 1)) >= out_h) {
+        level++;
+    }
+    return level;
+}
+
+// Decoded frames in one of these formats are handed out as-is in planar mode.
+static int is_native_planar(VNEVideo *v, enum AVPixelFormat fmt) {
+    if (fmt == v->out_fmt) return 1;
+    return v->out_fmt == AV_PIX_FMT_YUV420P && fmt == AV_PIX_FMT_YUVJ420P;
+}
+
+static int ensure_sws(VNEVideo *v, int width, int height, enum AVPixelFormat fmt) {
+    if (v->sws && v->sws_w == width && v->sws_h == height && v->sws_fmt == fmt) {
+        return 0;
+    }
+
+    if (v->sws) sws_freeContext(v->sws);
+    v->sws = NULL;
+
+    if (v->sws_threads > 1) {
+        // libswscale splits the output into horizontal slices on its own
+        // thread pool; each slice is computed exactly as the serial path would.
+        v->sws = sws_alloc_context();
+        if (v->sws) {
+            av_opt_set_int(v->sws, "srcw", width, 0);
+            av_opt_set_int(v->sws, "srch", height, 0);
+            av_opt_set_int(v->sws, "src_format", fmt, 0);
+            av_opt_set_int(v->sws, "dstw", v->out_w, 0);
+            av_opt_set_int(v->sws, "dsth", v->out_h, 0);
+            av_opt_set_int(v->sws, "dst_format", v->out_fmt, 0);
+            av_opt_set_int(v->sws, "sws_flags", scale_flags(v->opts.scale_filter), 0);
+            av_opt_set_int(v->sws, "threads", v->sws_threads, 0);
+            if (sws_init_context(v->sws, NULL, NULL) < 0) {
+                sws_freeContext(v->sws);
+                v->sws = NULL;
+            }
+        }
+    } else {
+        v->sws = sws_getContext(
+            width,
+            height,
+            fmt,
+            v->out_w,
+            v->out_h,
+            v->out_fmt,
+            scale_flags(v->opts.scale_filter),
+            NULL,
+            NULL,
+            NULL
+        );
+    }
+    if (!v->sws) {
+        set_error(v, "failed to create sws context");
+        return -1;
+    }
+    v->sws_w = width;
+    v->sws_h = height;
+    v->sws_fmt = fmt;
+    return 0;
+}
+
+static void sws_dst_noop_free(void *opaque, uint8_t *data) {
+    (void)opaque;
+    (void)data;
+}
+
+// Converts v->vframe into dst. The threaded path goes through the frame API,
+// which needs a refcounted destination, so dst is wrapped without copying.
+static int convert_frame(VNEVideo *v, uint8_t *dst_data[4], int dst_linesize[4], size_t dst_size) {
+    if (v->sws_threads <= 1) {
+        return sws_scale(v->sws,
+            (const uint8_t * const *)v->vframe->data,
+            v->vframe->linesize,
+            0,
+            v->vframe->height,
+            dst_data,
+            dst_linesize
+        );
+    }
+
+    if (!v->sws_dst) {
+        v->sws_dst = av_frame_alloc();
+        if (!v->sws_dst) return AVERROR(ENOMEM);
+    }
+
+    AVFrame *dst = v->sws_dst;
+    dst->buf[0] = av_buffer_create(dst_data[0], dst_size, sws_dst_noop_free, NULL, 0);
+    if (!dst->buf[0]) return AVERROR(ENOMEM);
+    for (int i = 0; i < 4; i++) {
+        dst->data[i] = dst_data[i];
+        dst->linesize[i] = dst_linesize[i];
+    }
+    dst->width = v->out_w;
+    dst->height = v->out_h;
+    dst->format = v->out_fmt;
+
+    int ret = sws_scale_frame(v->sws, dst, v->vframe);
+    av_frame_unref(dst);
+    return ret < 0 ? ret : v->out_h;
+}
+
+static int same_extradata(const AVCodecContext *dec, const AVCodecParameters *par) {
+    return dec->extradata_size == par->extradata_size
+        && (par->extradata_size == 0 || memcmp(dec->extradata, par->extradata, (size_t)par->extradata_size) == 0);
+}
+
+// vne_video_reopen: a decoder left from the previous asset is kept when the
+// new stream is the same codec with the same setup; it only needs a flush.
+static int video_decoder_reusable(VNEVideo *v, const AVCodecParameters *par) {
+    return v->vdec
+        && v->vdec->codec_id == par->codec_id
+        && v->src_w == par->width && v->src_h == par->height
+        && (par->format < 0 || par->format == v->vdec->pix_fmt)
+        && same_extradata(v->vdec, par);
+}
+
+static int audio_decoder_reusable(VNEVideo *v, const AVCodecParameters *par) {
+    int ch = v->adec ? (v->adec->ch_layout.nb_channels > 0 ? v->adec->ch_layout.nb_channels : v->adec->channels) : 0;
+    return v->adec
+        && v->adec->codec_id == par->codec_id
+        && v->adec->sample_rate == par->sample_rate
+        && ch == par->ch_layout.nb_channels
+        && (par->format < 0 || par->format == v->adec->sample_fmt)
+        && same_extradata(v->adec, par);
+}
+
+static int init_video_decoder(VNEVideo *v) {
+    if (v->opts.disable_video) return 0;
+
+    int idx = av_find_best_stream(v->fmt, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (idx < 0) {
+        v->vstream_index = -1;
+        v->vstream = NULL;
+        // A reopened handle may still carry the previous clip's video setup;
+        // audio-only handles report 0x0.
+        if (v->vdec) avcodec_free_context(&v->vdec);
+        v->src_w = v->src_h = 0;
+        v->out_w = v->out_h = 0;
+        return 0; // audio-only files are fine; finish_open checks for any stream
+    }
+    v->vstream_index = idx;
+    v->vstream = v->fmt->streams[idx];
+
+    AVCodecParameters *par = v->vstream->codecpar;
+    if (video_decoder_reusable(v, par)) {
+        // Output size, converter and pool carry over unchanged.
+        avcodec_flush_buffers(v->vdec);
+        return 0;
+    }
+    if (v->vdec) avcodec_free_context(&v->vdec);
+    v->src_w = par->width;
+    v->src_h = par->height;
+
+    const AVCodec *codec = avcodec_find_decoder(par->codec_id);
+    if (!codec) {
+        set_error(v, "video decoder not found");
+        return -1;
+    }
+
+    v->vdec = avcodec_alloc_context3(codec);
+    if (!v->vdec) {
+        set_error(v, "failed to alloc video codec context");
+        return -1;
+    }
+
+    if (avcodec_parameters_to_context(v->vdec, par) < 0) {
+        set_error(v, "failed to copy video codec parameters");
+        return -1;
+    }
+
+    apply_threading(v->vdec, v->opts.video_threads, v->opts.video_thread_type);
+
+    compute_output_size(v, par->width, par->height);
+    v->sws_threads = v->opts.convert_threads > 0 ? v->opts.convert_threads : av_cpu_count();
+    if (v->sws_threads > 16) v->sws_threads = 16;
+    if (v->opts.allow_lowres && par->width > 0 && par->height > 0) {
+        v->vdec->lowres = pick_lowres(codec, par->width, par->height, v->out_w, v->out_h);
+    }
+
+    if (avcodec_open2(v->vdec, codec, NULL) < 0) {
+        set_error(v, "failed to open video decoder");
+        return -1;
+    }
+
+    if (par->width <= 0 || par->height <= 0) {
+        compute_output_size(v, v->vdec->width, v->vdec->height);
+    }
+    v->out_fmt = output_pix_fmt(v->opts.output_format);
+
+    // Build the converter up front unless frames will pass through untouched.
+    // Without stream probing the pixel format may only be known at the first
+    // frame; the converter is then built there.
+    if (v->vdec->pix_fmt != AV_PIX_FMT_NONE
+        && (!is_native_planar(v, v->vdec->pix_fmt) || v->opts.output_format == VNE_PIXEL_RGBA)) {
+        if (ensure_sws(v, v->vdec->width, v->vdec->height, v->vdec->pix_fmt) < 0) {
+            return -1;
+        }
+    }
+
+    if (!v->vpool) v->vpool = vne_pool_create();
+    if (!v->vpool) {
+        set_error(v, "failed to create video frame pool");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int init_audio_decoder(VNEVideo *v) {
+    if (v->opts.disable_audio) return 0;
+
+    int idx = av_find_best_stream(v->fmt, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+    if (idx < 0) {
+        v->astream_index = -1;
+        v->astream = NULL;
+        // Drop a previous clip's audio output too, or the audio calls would
+        // still see a ring on a handle without audio.
+        if (v->adec) avcodec_free_context(&v->adec);
+        if (v->swr) swr_free(&v->swr);
+        free(v->sring.data);
+        v->sring.data = NULL;
+        return 0; // audio is optional
+    }
+
+    v->astream_index = idx;
+    v->astream = v->fmt->streams[idx];
+
+    AVCodecParameters *par = v->astream->codecpar;
+    if (audio_decoder_reusable(v, par)) {
+        // Same input and output setup: swr only drops what it buffered.
+        avcodec_flush_buffers(v->adec);
+        swr_init(v->swr);
+        return 0;
+    }
+    if (v->adec) avcodec_free_context(&v->adec);
+    free(v->sring.data);
+    v->sring.data = NULL;
+
+    const AVCodec *codec = avcodec_find_decoder(par->codec_id);
+    if (!codec) {
+        char msg[256];
+        snprintf(msg, sizeof(msg), "audio decoder not found for codec_id %d", par->codec_id);
+        set_error(v, msg);
+        return -1;
+    }
+
+    v->adec = avcodec_alloc_context3(codec);
+    if (!v->adec) {
+        set_error(v, "failed to alloc audio codec context (out of memory)");
+        return -1;
+    }
+
+    int ret = avcodec_parameters_to_context(v->adec, par);
+    if (ret < 0) {
+        set_ff_error(v, ret, "failed to copy audio codec parameters");
+        return -1;
+    }
+
+    apply_threading(v->adec, v->opts.audio_threads, v->opts.audio_thread_type);
+
+    ret = avcodec_open2(v->adec, codec, NULL);
+    if (ret < 0) {
+        set_ff_error(v, ret, "failed to open audio decoder");
+        return -1;
+    }
+
+    AVChannelLayout in_layout = {0};
+    int ch = v->adec->ch_layout.nb_channels > 0 ? v->adec->ch_layout.nb_channels : (v->adec->channels > 0 ? v->adec->channels : 2);
+    av_channel_layout_default(&in_layout, ch);
+
+    // Format, rate and channel count all change in this one swr pass.
+    enum AVSampleFormat out_fmt = output_sample_fmt(v->opts.audio_format);
+    int out_ch = v->opts.audio_channels > 0 ? v->opts.audio_channels : ch;
+    int out_rate = v->opts.audio_sample_rate > 0 ? v->opts.audio_sample_rate : v->adec->sample_rate;
+    if (out_ch > VNE_MAX_AUDIO_CHANNELS) {
+        set_error(v, "audio_channels is out of range");
+        return -1;
+    }
+    if (v->opts.audio_ring_ms > 0 && av_sample_fmt_is_planar(out_fmt)) {
+        set_error(v, "audio_ring_ms needs an interleaved audio_format");
+        return -1;
+    }
+
+    AVChannelLayout out_layout = {0};
+    av_channel_layout_default(&out_layout, out_ch);
+
+    ret = swr_alloc_set_opts2(
+        &v->swr,
         &out_layout,
-        AV_SAMPLE_FMT_S16,
-        v->adec->sample_rate,
+        out_fmt,
+        out_rate,
         &in_layout,
         v->adec->sample_fmt,
         v->adec->sample_rate,
@@ -336,471 +1315,2827 @@ static int init_audio_decoder(VNEVideo *v) {
         return -1;
     }
     
-    v->out_sample_fmt = AV_SAMPLE_FMT_S16;
+    v->out_sample_fmt = out_fmt;
     av_opt_get_sample_fmt(v->swr, "out_sample_fmt", 0, &v->out_sample_fmt);
+    v->out_sample_rate = out_rate;
+    v->out_channels = out_ch;
+    v->out_bytes_per_sample = av_get_bytes_per_sample(v->out_sample_fmt);
+
+    // Size pooled buffers once from the largest frame the stream can produce.
+    // Variable-size codecs (Vorbis) report 0; 8192 covers their biggest block.
+    int max_in = v->adec->frame_size > 0 ? v->adec->frame_size : 8192;
+    v->audio_max_samples = swr_get_out_samples(v->swr, max_in);
+    if (v->audio_max_samples < max_in) v->audio_max_samples = max_in;
+
+    if (!v->apool) v->apool = vne_pool_create();
+    if (!v->apool) {
+        set_error(v, "failed to create audio buffer pool");
+        return -1;
+    }
+
+    if (v->opts.audio_ring_ms > 0) {
+        // Room for at least two frames so the producer always makes progress.
+        int64_t want = (int64_t)v->opts.audio_ring_ms * v->out_sample_rate / 1000;
+        if (want < 2 * (int64_t)v->audio_max_samples) want = 2 * (int64_t)v->audio_max_samples;
+        unsigned n = 1;
+        while (n < (uint64_t)want && n < (1u << 30)) n <<= 1;
+
+        VNESampleRing *r = &v->sring;
+        r->frame_bytes = v->out_channels * v->out_bytes_per_sample;
+        r->data = (uint8_t *)calloc(n, (size_t)r->frame_bytes);
+        if (!r->data) {
+            set_error(v, "failed to allocate audio ring");
+            return -1;
+        }
+        r->capacity = n;
+        r->mask = n - 1;
+    }
 
     return 0;
 }
 
+void vne_video_default_options(VNEOpenOptions *opts) {
+    if (!opts) return;
+    memset(opts, 0, sizeof(*opts));
+    opts->video_threads = 0;
+    opts->video_thread_type = VNE_THREAD_AUTO;
+    opts->audio_threads = 1;
+    opts->audio_thread_type = VNE_THREAD_AUTO;
+    opts->convert_threads = 1;
+}
+
 VNEVideo *vne_video_open(const char *path, VNEVideoInfo *out_info) {
-    if (!path) return NULL;
+    return vne_video_open_ex(path, NULL, out_info);
+}
 
+static VNEVideo *vne_video_create(const VNEOpenOptions *opts) {
     VNEVideo *v = (VNEVideo *)calloc(1, sizeof(VNEVideo));
     if (!v) return NULL;
 
+    if (opts) {
+        v->opts = *opts;
+    } else {
+        vne_video_default_options(&v->opts);
+    }
+
     v->vstream_index = -1;
     v->astream_index = -1;
+    v->video_skip_ms = AV_NOPTS_VALUE;
+    v->audio_skip_ms = AV_NOPTS_VALUE;
+    v->fcache_prev_pts = AV_NOPTS_VALUE;
+    v->scrub_pts_ms = AV_NOPTS_VALUE;
+    vne_mutex_init(&v->demux_lock);
+    vne_mutex_init(&v->video_lock);
+    vne_mutex_init(&v->audio_lock);
 
     av_log_set_level(AV_LOG_ERROR);
+    return v;
+}
 
-    FILE *fp = fopen(path, "rb");
-    int64_t data_size = 0;
-    int probe = 0;
+static void apply_probe_limits(VNEVideo *v) {
+    if (v->opts.probesize > 0) {
+        v->fmt->probesize = v->opts.probesize < 32 ? 32 : v->opts.probesize;
+    }
+    if (v->opts.analyze_duration_ms > 0) {
+        v->fmt->max_analyze_duration = v->opts.analyze_duration_ms * 1000;
+    }
+}
 
-    if (fp) {
-        probe = vne_video_probe_header(fp, &data_size);
-        if (probe < 0) {
-            set_error(v, "invalid .video header");
-            fclose(fp);
-            vne_video_close(v);
-            return NULL;
-        }
+// Opens the demuxer on v->io through our AVIO callbacks.
+static int open_custom_io(VNEVideo *v) {
+    int avio_buf_size = 64 * 1024;
+    unsigned char *avio_buf = v->avio_buf;
+    if (avio_buf) {
+        avio_buf_size = v->avio_buf_size;
+        v->avio_buf = NULL;
+    } else {
+        avio_buf = (unsigned char *)av_malloc((size_t)avio_buf_size);
+    }
+    if (!avio_buf) {
+        set_error(v, "out of memory for avio buffer");
+        return -1;
     }
 
-    int ret = 0;
-    if (probe == 1) {
-        VNEVideoIO *io = (VNEVideoIO *)calloc(1, sizeof(VNEVideoIO));
-        if (!io) {
-            set_error(v, "out of memory for io");
-            fclose(fp);
-            vne_video_close(v);
-            return NULL;
-        }
-        io->fp = fp;
-        io->data_offset = 16;
-        io->data_size = data_size;
-        io->pos = 0;
+    v->avio = avio_alloc_context(avio_buf, avio_buf_size, 0, v->io, vne_video_read, NULL, vne_video_seek);
+    if (!v->avio) {
+        av_free(avio_buf);
+        set_error(v, "failed to create avio context");
+        return -1;
+    }
 
-        v->io = io;
+    v->avio->seekable = AVIO_SEEKABLE_NORMAL;
 
-        const int avio_buf_size = 64 * 1024;
-        unsigned char *avio_buf = (unsigned char *)av_malloc((size_t)avio_buf_size);
-        if (!avio_buf) {
-            set_error(v, "out of memory for avio buffer");
-            vne_video_close(v);
-            return NULL;
-        }
+    v->fmt = avformat_alloc_context();
+    if (!v->fmt) {
+        set_error(v, "failed to alloc format context");
+        return -1;
+    }
+    v->fmt->pb = v->avio;
+    v->fmt->flags |= AVFMT_FLAG_CUSTOM_IO;
+    apply_probe_limits(v);
 
-        v->avio = avio_alloc_context(avio_buf, avio_buf_size, 0, io, vne_video_read, NULL, vne_video_seek);
-        if (!v->avio) {
-            av_free(avio_buf);
-            set_error(v, "failed to create avio context");
-            vne_video_close(v);
-            return NULL;
+    int ret = avformat_open_input(&v->fmt, NULL, NULL, NULL);
+    if (ret < 0) {
+        set_ff_error(v, ret, "avformat_open_input (custom io) failed");
+        return -1;
+    }
+    return 0;
+}
+
+// Takes over the container's keyframe index and creates the custom IO.
+static int attach_io(VNEVideo *v, VNEContainer *container) {
+    VNEVideoIO *io = (VNEVideoIO *)calloc(1, sizeof(VNEVideoIO));
+    if (!io) {
+        set_error(v, "out of memory for io");
+        container_free(container);
+        return -1;
+    }
+    io->data_offset = container->data_offset;
+    io->data_size = container->data_size;
+    io->pos = 0;
+    io->file_pos = -1;
+
+    v->io = io;
+    v->kindex = container->index;
+    v->kindex_count = container->index_count;
+    v->cache = container->cache;
+    container->index = NULL;
+    container->cache = NULL;
+    return 0;
+}
+
+static int set_cached_extradata(AVCodecParameters *par, const VNECodecCache *cc) {
+    if (par->extradata_size > 0 || cc->extradata_size <= 0) return 0;
+    par->extradata = (uint8_t *)av_mallocz((size_t)cc->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (!par->extradata) return -1;
+    memcpy(par->extradata, cc->extradata, (size_t)cc->extradata_size);
+    par->extradata_size = cc->extradata_size;
+    return 0;
+}
+
+static enum AVCodecID cached_codec_id(const VNECodecCache *cc) {
+    const AVCodecDescriptor *desc = avcodec_descriptor_get_by_name(cc->codec);
+    return desc ? desc->id : AV_CODEC_ID_NONE;
+}
+
+// Fills what the demuxer header did not provide from the cached parameters,
+// in place of avformat_find_stream_info decoding frames to learn them.
+static int apply_stream_cache(VNEVideo *v) {
+    const VNEStreamCache *cache = v->cache;
+    int have_video = 0;
+    int have_audio = 0;
+
+    for (unsigned i = 0; i < v->fmt->nb_streams; i++) {
+        AVCodecParameters *par = v->fmt->streams[i]->codecpar;
+        const VNECodecCache *cc = NULL;
+
+        if (par->codec_type == AVMEDIA_TYPE_VIDEO && !have_video) {
+            cc = &cache->video;
+            have_video = 1;
+        } else if (par->codec_type == AVMEDIA_TYPE_AUDIO && !have_audio) {
+            cc = &cache->audio;
+            have_audio = 1;
         }
+        if (!cc || !cc->present) continue;
 
-        v->avio->seekable = AVIO_SEEKABLE_NORMAL;
+        if (par->codec_id == AV_CODEC_ID_NONE) par->codec_id = cached_codec_id(cc);
+        if (set_cached_extradata(par, cc) < 0) return -1;
 
-        v->fmt = avformat_alloc_context();
-        if (!v->fmt) {
-            set_error(v, "failed to alloc format context");
-            vne_video_close(v);
-            return NULL;
+        if (par->codec_type == AVMEDIA_TYPE_VIDEO) {
+            if (par->format < 0) par->format = av_get_pix_fmt(cc->format);
+            if (par->width <= 0) par->width = cc->width;
+            if (par->height <= 0) par->height = cc->height;
+        } else {
+            if (par->format < 0) par->format = av_get_sample_fmt(cc->format);
+            if (par->sample_rate <= 0) par->sample_rate = cc->sample_rate;
+            if (par->frame_size <= 0) par->frame_size = cc->frame_size;
+            if (par->ch_layout.nb_channels <= 0 && cc->channels > 0) {
+                av_channel_layout_uninit(&par->ch_layout);
+                if (!cc->channel_mask || av_channel_layout_from_mask(&par->ch_layout, cc->channel_mask) < 0) {
+                    av_channel_layout_default(&par->ch_layout, cc->channels);
+                }
+            }
         }
-        v->fmt->pb = v->avio;
-        v->fmt->flags |= AVFMT_FLAG_CUSTOM_IO;
+    }
+    return 0;
+}
 
-        ret = avformat_open_input(&v->fmt, NULL, NULL, NULL);
-        if (ret < 0) {
-            set_ff_error(v, ret, "avformat_open_input (custom io) failed");
-            vne_video_close(v);
-            return NULL;
+// The demuxer drops packets of discarded streams before they reach us, so
+// disabled and unused streams cost no reads beyond the container itself.
+static void discard_unused_streams(VNEVideo *v) {
+    for (unsigned i = 0; i < v->fmt->nb_streams; i++) {
+        int keep = (int)i == v->vstream_index || (int)i == v->astream_index;
+        v->fmt->streams[i]->discard = keep ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+    }
+}
+
+// Everything after the demuxer is open: stream info, decoders, info.
+static int finish_open(VNEVideo *v, VNEVideoInfo *out_info) {
+    if (v->cache && v->cache->has_info) {
+        if (apply_stream_cache(v) < 0) {
+            set_error(v, "failed to apply cached stream parameters");
+            return -1;
         }
     } else {
-        if (fp) fclose(fp);
-        ret = avformat_open_input(&v->fmt, path, NULL, NULL);
+        int ret = avformat_find_stream_info(v->fmt, NULL);
         if (ret < 0) {
-            set_ff_error(v, ret, "avformat_open_input failed");
-            vne_video_close(v);
-            return NULL;
+            set_ff_error(v, ret, "avformat_find_stream_info failed");
+            return -1;
         }
     }
 
-    ret = avformat_find_stream_info(v->fmt, NULL);
-    if (ret < 0) {
-        set_ff_error(v, ret, "avformat_find_stream_info failed");
-        vne_video_close(v);
-        return NULL;
-    }
-
     if (init_video_decoder(v) < 0) {
-        vne_video_close(v);
-        return NULL;
+        return -1;
     }
 
+    install_keyframe_index(v);
+
     if (init_audio_decoder(v) < 0) {
-        vne_video_close(v);
-        return NULL;
+        return -1;
     }
 
-    v->vframe = av_frame_alloc();
-    v->aframe = av_frame_alloc();
-    v->pkt = av_packet_alloc();
-    if (!v->vframe || !v->aframe || !v->pkt) {
-        set_error(v, "failed to allocate frame or packet");
-        vne_video_close(v);
-        return NULL;
+    if (!v->vdec && !v->adec) {
+        set_error(v, v->opts.disable_video ? "no audio stream found" : "no video stream found");
+        return -1;
+    }
+    discard_unused_streams(v);
+
+    // A reopened handle keeps its frames and packets.
+    if (!v->vframe) v->vframe = av_frame_alloc();
+    if (!v->aframe) v->aframe = av_frame_alloc();
+    if (!v->pkt) v->pkt = av_packet_alloc();
+    if (!v->vpkt) v->vpkt = av_packet_alloc();
+    if (!v->apkt) v->apkt = av_packet_alloc();
+    if (!v->vnext) v->vnext = av_frame_alloc();
+    if (!v->vdue) v->vdue = av_frame_alloc();
+    if (!v->vframe || !v->aframe || !v->pkt || !v->vpkt || !v->apkt || !v->vnext || !v->vdue) {
+        set_error(v, "failed to allocate frame or packet");
+        return -1;
     }
 
     if (out_info) {
         memset(out_info, 0, sizeof(*out_info));
-        out_info->width = v->vdec->width;
-        out_info->height = v->vdec->height;
+        out_info->width = v->out_w;
+        out_info->height = v->out_h;
 
-        AVRational fr = av_guess_frame_rate(v->fmt, v->vstream, NULL);
-        out_info->fps_num = fr.num;
-        out_info->fps_den = fr.den;
+        if (v->vstream) {
+            AVRational fr = av_guess_frame_rate(v->fmt, v->vstream, NULL);
+            out_info->fps_num = fr.num;
+            out_info->fps_den = fr.den;
+        }
 
         if (v->fmt->duration > 0) {
             out_info->duration_ms = v->fmt->duration / 1000;
         }
 
-        if (v->adec) {
-            out_info->has_audio = 1;
-            out_info->sample_rate = v->adec->sample_rate;
-            out_info->channels = v->adec->ch_layout.nb_channels > 0 ? v->adec->ch_layout.nb_channels : v->adec->channels;
-        }
+        if (v->cache && v->cache->has_info) {
+            // Without probing the demuxer may not know these; the build tool did.
+            if (v->vstream && v->cache->info.fps_num > 0 && v->cache->info.fps_den > 0) {
+                out_info->fps_num = v->cache->info.fps_num;
+                out_info->fps_den = v->cache->info.fps_den;
+            }
+            if (out_info->duration_ms <= 0) {
+                out_info->duration_ms = v->cache->info.duration_ms;
+            }
+        }
+
+        if (v->adec) {
+            out_info->has_audio = 1;
+            out_info->sample_rate = v->out_sample_rate;
+            out_info->channels = v->out_channels;
+        }
+    }
+
+    stream_cache_free(v->cache);
+    v->cache = NULL;
+    return 0;
+}
+
+// Opens path into a handle from vne_video_create; closes it on failure.
+static VNEVideo *open_path(VNEVideo *v, const char *path, VNEVideoInfo *out_info) {
+    FILE *fp = fopen(path, "rb");
+    VNEContainer container;
+    int probe = 0;
+
+    memset(&container, 0, sizeof(container));
+    if (fp) {
+        probe = vne_video_probe_header(fp, &container);
+        if (probe < 0) {
+            set_error(v, "invalid .video header");
+            fclose(fp);
+            vne_video_close(v);
+            return NULL;
+        }
+    }
+
+    if (probe == 1) {
+        if (attach_io(v, &container) < 0) {
+            fclose(fp);
+            vne_video_close(v);
+            return NULL;
+        }
+
+        // Prefer reading through a mapping: no seek + fread per AVIO refill and
+        // handles on the same asset share the page cache.
+        v->io->map = vne_map_open(fp);
+        if (v->io->map) {
+            fclose(fp);
+            v->io->base = v->io->map->data;
+#if !defined(_WIN32)
+            vne_map_advise(v->io->map, v->io->data_offset, v->io->data_size, MADV_SEQUENTIAL);
+#endif
+        } else {
+            v->io->fp = fp;
+        }
+
+        if (open_custom_io(v) < 0) {
+            vne_video_close(v);
+            return NULL;
+        }
+    } else {
+        if (fp) fclose(fp);
+        v->fmt = avformat_alloc_context();
+        if (!v->fmt) {
+            set_error(v, "failed to alloc format context");
+            vne_video_close(v);
+            return NULL;
+        }
+        apply_probe_limits(v);
+        int ret = avformat_open_input(&v->fmt, path, NULL, NULL);
+        if (ret < 0) {
+            set_ff_error(v, ret, "avformat_open_input failed");
+            vne_video_close(v);
+            return NULL;
+        }
+    }
+
+    if (finish_open(v, out_info) < 0) {
+        vne_video_close(v);
+        return NULL;
+    }
+
+    return v;
+}
+
+VNEVideo *vne_video_open_ex(const char *path, const VNEOpenOptions *opts, VNEVideoInfo *out_info) {
+    if (!path) return NULL;
+
+    VNEVideo *v = vne_video_create(opts);
+    if (!v) return NULL;
+    return open_path(v, path, out_info);
+}
+
+VNEVideo *vne_video_open_memory(const void *data, size_t size, const VNEOpenOptions *opts, VNEVideoInfo *out_info) {
+    if (!data || size == 0) return NULL;
+
+    VNEVideo *v = vne_video_create(opts);
+    if (!v) return NULL;
+
+    VNEContainer container;
+    int probe = parse_container((const uint8_t *)data, size, (int64_t)size, &container);
+    if (probe < 0) {
+        set_error(v, "invalid .video header");
+        vne_video_close(v);
+        return NULL;
+    }
+    if (probe == 0) {
+        // Plain media bytes: the whole buffer is the payload.
+        container.data_offset = 0;
+        container.data_size = (int64_t)size;
+    }
+
+    if (attach_io(v, &container) < 0) {
+        vne_video_close(v);
+        return NULL;
+    }
+    v->io->base = (const uint8_t *)data;
+
+    if (open_custom_io(v) < 0 || finish_open(v, out_info) < 0) {
+        vne_video_close(v);
+        return NULL;
+    }
+
+    return v;
+}
+
+// Pack: one mapped file holding many payloads plus a directory with cached
+// metadata. Entries are opened as VNEVideoIO windows over the shared mapping.
+typedef struct VNEPackEntry {
+    char *name;
+    int64_t offset;
+    int64_t size;
+    VNEVideoInfo info;
+} VNEPackEntry;
+
+struct VNEVideoPack {
+    VNEFileMap *map;
+    VNEPackEntry *entries;
+    int count;
+};
+
+#define VNE_PACK_HEADER_SIZE 16
+#define VNE_PACK_ENTRY_FIXED 52 // offset, size and cached VNEVideoInfo
+
+static int parse_pack_entry(const uint8_t *p, size_t avail, int64_t file_size, VNEPackEntry *e, size_t *used) {
+    if (avail < 2) return -1;
+    size_t name_len = (size_t)p[0] | ((size_t)p[1] << 8);
+    if (avail - 2 < name_len + VNE_PACK_ENTRY_FIXED) return -1;
+
+    e->name = (char *)malloc(name_len + 1);
+    if (!e->name) return -1;
+    memcpy(e->name, p + 2, name_len);
+    e->name[name_len] = '\0';
+
+    const uint8_t *f = p + 2 + name_len;
+    e->offset = (int64_t)rd_le64(f);
+    e->size = (int64_t)rd_le64(f + 8);
+    e->info.width = (int)rd_le32(f + 16);
+    e->info.height = (int)rd_le32(f + 20);
+    e->info.fps_num = (int)rd_le32(f + 24);
+    e->info.fps_den = (int)rd_le32(f + 28);
+    e->info.duration_ms = (int64_t)rd_le64(f + 32);
+    e->info.has_audio = (int)rd_le32(f + 40);
+    e->info.sample_rate = (int)rd_le32(f + 44);
+    e->info.channels = (int)rd_le32(f + 48);
+
+    if (e->offset < 0 || e->size <= 0 || e->offset > file_size || e->size > file_size - e->offset) {
+        return -1;
+    }
+
+    *used = 2 + name_len + VNE_PACK_ENTRY_FIXED;
+    return 0;
+}
+
+VNEVideoPack *vne_video_pack_open(const char *path) {
+    if (!path) return NULL;
+
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return NULL;
+    VNEFileMap *map = vne_map_open(fp);
+    fclose(fp);
+    if (!map) return NULL;
+
+    const uint8_t *p = map->data;
+    if (map->size < VNE_PACK_HEADER_SIZE || memcmp(p, "VPK0", 4) != 0 || rd_le32(p + 4) != 1) {
+        vne_map_unref(map);
+        return NULL;
+    }
+
+    uint32_t count = rd_le32(p + 8);
+    uint32_t dir_size = rd_le32(p + 12);
+    if ((int64_t)dir_size > map->size - VNE_PACK_HEADER_SIZE || count > dir_size / (2 + VNE_PACK_ENTRY_FIXED)) {
+        vne_map_unref(map);
+        return NULL;
+    }
+
+    VNEVideoPack *pack = (VNEVideoPack *)calloc(1, sizeof(VNEVideoPack));
+    if (!pack) {
+        vne_map_unref(map);
+        return NULL;
+    }
+    pack->map = map;
+    pack->entries = count ? (VNEPackEntry *)calloc(count, sizeof(VNEPackEntry)) : NULL;
+    if (count && !pack->entries) {
+        vne_video_pack_close(pack);
+        return NULL;
+    }
+
+    const uint8_t *dir = p + VNE_PACK_HEADER_SIZE;
+    size_t off = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        size_t used = 0;
+        if (parse_pack_entry(dir + off, dir_size - off, map->size, &pack->entries[i], &used) < 0) {
+            pack->count = (int)i + 1; // free the partially parsed name too
+            vne_video_pack_close(pack);
+            return NULL;
+        }
+        off += used;
+        pack->count = (int)i + 1;
+    }
+
+    return pack;
+}
+
+void vne_video_pack_close(VNEVideoPack *pack) {
+    if (!pack) return;
+    for (int i = 0; i < pack->count; i++) {
+        free(pack->entries[i].name);
+    }
+    free(pack->entries);
+    // Entries still open keep their own reference to the mapping.
+    vne_map_unref(pack->map);
+    free(pack);
+}
+
+int vne_video_pack_count(const VNEVideoPack *pack) {
+    return pack ? pack->count : 0;
+}
+
+int vne_video_pack_find(const VNEVideoPack *pack, const char *name) {
+    if (!pack || !name) return -1;
+    for (int i = 0; i < pack->count; i++) {
+        if (strcmp(pack->entries[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+const char *vne_video_pack_name(const VNEVideoPack *pack, int index) {
+    if (!pack || index < 0 || index >= pack->count) return NULL;
+    return pack->entries[index].name;
+}
+
+int vne_video_pack_info(const VNEVideoPack *pack, int index, VNEVideoInfo *out_info) {
+    if (!pack || !out_info || index < 0 || index >= pack->count) return -1;
+    *out_info = pack->entries[index].info;
+    return 0;
+}
+
+VNEVideo *vne_video_pack_open_entry(VNEVideoPack *pack, int index, const VNEOpenOptions *opts, VNEVideoInfo *out_info) {
+    if (!pack || index < 0 || index >= pack->count) return NULL;
+
+    const VNEPackEntry *e = &pack->entries[index];
+    VNEVideo *v = vne_video_create(opts);
+    if (!v) return NULL;
+
+    // An entry is either raw media or a full .video container.
+    VNEContainer container;
+    int probe = parse_container(pack->map->data + e->offset, (size_t)e->size, e->size, &container);
+    if (probe < 0) {
+        set_error(v, "invalid .video header in pack entry");
+        vne_video_close(v);
+        return NULL;
+    }
+    if (probe == 0) {
+        container.data_offset = 0;
+        container.data_size = e->size;
+    }
+    container.data_offset += e->offset;
+
+    if (attach_io(v, &container) < 0) {
+        vne_video_close(v);
+        return NULL;
+    }
+    vne_atomic_add(&pack->map->refs, 1);
+    v->io->map = pack->map;
+    v->io->base = pack->map->data;
+#if !defined(_WIN32)
+    vne_map_advise(v->io->map, v->io->data_offset, v->io->data_size, MADV_SEQUENTIAL);
+#endif
+
+    if (open_custom_io(v) < 0 || finish_open(v, out_info) < 0) {
+        vne_video_close(v);
+        return NULL;
+    }
+
+    return v;
+}
+
+VNEVideo *vne_video_pack_open_name(VNEVideoPack *pack, const char *name, const VNEOpenOptions *opts, VNEVideoInfo *out_info) {
+    return vne_video_pack_open_entry(pack, vne_video_pack_find(pack, name), opts, out_info);
+}
+
+static void async_stop(VNEVideo *v);
+static void ring_free(VNEFrameRing *r);
+static void pq_flush(VNEPacketQueue *q);
+static void frame_cache_clear(VNEVideo *v);
+static void repeat_reset(VNEVideo *v);
+
+void vne_video_close(VNEVideo *v) {
+    if (!v) return;
+
+    if (v->sched) vne_scheduler_remove(v->sched, v);
+    async_stop(v);
+    ring_free(&v->vring);
+    ring_free(&v->aring);
+    if (v->async_sync_init) {
+        vne_cond_destroy(&v->async_cond);
+        vne_mutex_destroy(&v->async_lock);
+    }
+
+    pq_flush(&v->vqueue);
+    pq_flush(&v->aqueue);
+    if (v->pkt) av_packet_free(&v->pkt);
+    if (v->vpkt) av_packet_free(&v->vpkt);
+    if (v->apkt) av_packet_free(&v->apkt);
+    if (v->vframe) av_frame_free(&v->vframe);
+    if (v->aframe) av_frame_free(&v->aframe);
+    if (v->vnext) av_frame_free(&v->vnext);
+    if (v->vdue) av_frame_free(&v->vdue);
+
+    if (v->sws) sws_freeContext(v->sws);
+    if (v->sws_dst) av_frame_free(&v->sws_dst);
+    if (v->swr) swr_free(&v->swr);
+    frame_cache_clear(v);
+    repeat_reset(v);
+    if (v->vprev) av_frame_free(&v->vprev);
+    vne_pool_close(v->vpool);
+    vne_pool_close(v->apool);
+    free(v->sring.data);
+
+    if (v->vdec) avcodec_free_context(&v->vdec);
+    if (v->adec) avcodec_free_context(&v->adec);
+
+    if (v->fmt) avformat_close_input(&v->fmt);
+    if (v->avio) {
+        av_freep(&v->avio->buffer);
+        avio_context_free(&v->avio);
+    }
+    av_free(v->avio_buf);
+    if (v->io) {
+        if (v->io->fp) fclose(v->io->fp);
+        vne_map_unref(v->io->map);
+        free(v->io);
+    }
+    free(v->kindex);
+    stream_cache_free(v->cache);
+
+    vne_mutex_destroy(&v->demux_lock);
+    vne_mutex_destroy(&v->video_lock);
+    vne_mutex_destroy(&v->audio_lock);
+    free(v);
+}
+
+const char *vne_video_last_error(VNEVideo *v) {
+    if (!v) return "no handle";
+    return v->last_error[0] ? v->last_error : "";
+}
+
+static int color_space_of(const AVFrame *f) {
+    switch (f->colorspace) {
+    case AVCOL_SPC_BT709:
+        return VNE_COLORSPACE_BT709;
+    case AVCOL_SPC_BT2020_NCL:
+    case AVCOL_SPC_BT2020_CL:
+        return VNE_COLORSPACE_BT2020;
+    case AVCOL_SPC_BT470BG:
+    case AVCOL_SPC_SMPTE170M:
+        return VNE_COLORSPACE_BT601;
+    default:
+        // Untagged: same guess as most players, HD is 709 and SD is 601.
+        return f->height >= 720 ? VNE_COLORSPACE_BT709 : VNE_COLORSPACE_BT601;
+    }
+}
+
+static int color_range_of(const AVFrame *f, int converted) {
+    // swscale maps the YUVJ (full range) formats to limited range output.
+    if (f->format == AV_PIX_FMT_YUVJ420P) {
+        return converted ? VNE_RANGE_LIMITED : VNE_RANGE_FULL;
+    }
+    return f->color_range == AVCOL_RANGE_JPEG ? VNE_RANGE_FULL : VNE_RANGE_LIMITED;
+}
+
+static int plane_count_of(enum AVPixelFormat fmt) {
+    return fmt == AV_PIX_FMT_YUV420P ? 3 : 2;
+}
+
+// Hands the decoded frame out without conversion or copy. The planar frame
+// takes over v->vframe's buffer references.
+static int emit_native_planar(VNEVideo *v, VNEPlanarFrame *out) {
+    AVFrame *ref = av_frame_alloc();
+    if (!ref) {
+        set_error(v, "failed to allocate planar frame");
+        return -1;
+    }
+    av_frame_move_ref(ref, v->vframe);
+
+    int planes = plane_count_of(v->out_fmt);
+    for (int i = 0; i < 3; i++) {
+        out->planes[i] = i < planes ? ref->data[i] : NULL;
+        out->strides[i] = i < planes ? ref->linesize[i] : 0;
+    }
+    out->plane_count = planes;
+    out->width = ref->width;
+    out->height = ref->height;
+    out->format = v->opts.output_format;
+    out->colorspace = color_space_of(ref);
+    out->color_range = color_range_of(ref, 0);
+    out->pts_ms = pts_to_ms(v->vstream, ref->best_effort_timestamp);
+    out->priv = ref;
+    return 1;
+}
+
+static int emit_converted_planar(VNEVideo *v, VNEPlanarFrame *out) {
+    uint8_t *dst_data[4] = { 0 };
+    int dst_linesize[4] = { 0 };
+
+    int size = av_image_get_buffer_size(v->out_fmt, v->out_w, v->out_h, 64);
+    uint8_t *buf = size > 0 ? vne_pool_get(v->vpool, (size_t)size) : NULL;
+    if (!buf) {
+        set_error(v, "failed to allocate planar image buffer");
+        return -1;
+    }
+    av_image_fill_arrays(dst_data, dst_linesize, buf, v->out_fmt, v->out_w, v->out_h, 64);
+
+    int scaled = convert_frame(v, dst_data, dst_linesize, (size_t)size);
+    if (scaled <= 0) {
+        vne_pool_release(buf);
+        set_error(v, "sws_scale failed");
+        return -1;
+    }
+
+    int planes = plane_count_of(v->out_fmt);
+    for (int i = 0; i < 3; i++) {
+        out->planes[i] = i < planes ? dst_data[i] : NULL;
+        out->strides[i] = i < planes ? dst_linesize[i] : 0;
+    }
+    out->plane_count = planes;
+    out->width = v->out_w;
+    out->height = v->out_h;
+    out->format = v->opts.output_format;
+    out->colorspace = color_space_of(v->vframe);
+    out->color_range = color_range_of(v->vframe, 1);
+    out->pts_ms = pts_to_ms(v->vstream, v->vframe->best_effort_timestamp);
+    out->priv = NULL;
+    return 1;
+}
+
+static VNECachedFrame *frame_cache_find(VNEVideo *v, int64_t pts_ms) {
+    for (int i = 0; i < v->fcache_count; i++) {
+        if (v->fcache[i].pts_ms == pts_ms) return &v->fcache[i];
+    }
+    return NULL;
+}
+
+// The cached frame on screen at target_ms, if the cache can tell.
+static VNECachedFrame *frame_cache_lookup(VNEVideo *v, int64_t target_ms) {
+    for (int i = 0; i < v->fcache_count; i++) {
+        VNECachedFrame *e = &v->fcache[i];
+        if (e->pts_ms <= target_ms && target_ms < e->next_pts_ms) {
+            e->used = ++v->fcache_clock;
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static void frame_cache_evict(VNEVideo *v, size_t frame_bytes) {
+    int lru = 0;
+    for (int i = 1; i < v->fcache_count; i++) {
+        if (v->fcache[i].used < v->fcache[lru].used) lru = i;
+    }
+    vne_pool_release(v->fcache[lru].data);
+    v->fcache[lru] = v->fcache[--v->fcache_count];
+    v->fcache_bytes -= frame_bytes;
+}
+
+static void frame_cache_insert(VNEVideo *v, uint8_t *data, int stride, int64_t pts_ms) {
+    size_t frame_bytes = (size_t)stride * (size_t)v->out_h;
+    if (pts_ms < 0 || frame_bytes > (size_t)v->opts.frame_cache_bytes) return;
+
+    // While the decoder skips non-reference frames, the previous frame may
+    // not be the one before this.
+    if (v->vdec && v->vdec->skip_frame != AVDISCARD_DEFAULT) v->fcache_prev_pts = AV_NOPTS_VALUE;
+    if (v->fcache_prev_pts != AV_NOPTS_VALUE && pts_ms > v->fcache_prev_pts) {
+        VNECachedFrame *prev = frame_cache_find(v, v->fcache_prev_pts);
+        if (prev) prev->next_pts_ms = pts_ms;
+    }
+    v->fcache_prev_pts = pts_ms;
+
+    VNECachedFrame *e = frame_cache_find(v, pts_ms);
+    if (e) {
+        e->used = ++v->fcache_clock;
+        return;
+    }
+
+    while (v->fcache_count > 0 && v->fcache_bytes + frame_bytes > (size_t)v->opts.frame_cache_bytes) {
+        frame_cache_evict(v, frame_bytes);
+    }
+    if (v->fcache_count == v->fcache_cap) {
+        int cap = v->fcache_cap ? v->fcache_cap * 2 : 16;
+        VNECachedFrame *grown = (VNECachedFrame *)realloc(v->fcache, (size_t)cap * sizeof(*grown));
+        if (!grown) return;
+        v->fcache = grown;
+        v->fcache_cap = cap;
+    }
+
+    vne_pool_ref(data);
+    e = &v->fcache[v->fcache_count++];
+    e->pts_ms = pts_ms;
+    e->next_pts_ms = pts_ms + 1;
+    e->data = data;
+    e->used = ++v->fcache_clock;
+    v->fcache_bytes += frame_bytes;
+}
+
+static void frame_cache_clear(VNEVideo *v) {
+    for (int i = 0; i < v->fcache_count; i++) {
+        vne_pool_release(v->fcache[i].data);
+    }
+    free(v->fcache);
+    v->fcache = NULL;
+    v->fcache_count = 0;
+    v->fcache_cap = 0;
+    v->fcache_bytes = 0;
+}
+
+static int emit_rgba(VNEVideo *v, const VNEVideoTarget *vt) {
+    uint8_t *dst = vt->dst;
+    int dst_stride = vt->dst_stride;
+    uint8_t *pooled = NULL;
+
+    if (!dst) {
+        dst_stride = FFALIGN(v->out_w * 4, 64);
+        pooled = vne_pool_get(v->vpool, (size_t)dst_stride * (size_t)v->out_h);
+        if (!pooled) {
+            set_error(v, "failed to allocate video image buffer");
+            return -1;
+        }
+        dst = pooled;
+    }
+
+    VNEF_LOG("[VIDEO] Converting into %s buffer at %p\n", pooled ? "pooled" : "caller", (void*)dst);
+    fflush(stderr);
+
+    uint8_t *dst_data[4] = { dst, NULL, NULL, NULL };
+    int dst_linesize[4] = { dst_stride, 0, 0, 0 };
+
+    int scaled = convert_frame(v, dst_data, dst_linesize, (size_t)dst_stride * (size_t)v->out_h);
+    if (scaled <= 0) {
+        vne_pool_release(pooled);
+        set_error(v, "sws_scale failed");
+        return -1;
+    }
+
+    VNEVideoFrame *out_video = vt->rgba;
+    out_video->width = v->out_w;
+    out_video->height = v->out_h;
+    out_video->stride = dst_stride;
+    out_video->data = dst;
+    out_video->pts_ms = pts_to_ms(v->vstream, v->vframe->best_effort_timestamp);
+    out_video->repeat = 0;
+    if (pooled && v->opts.frame_cache_bytes > 0) {
+        frame_cache_insert(v, pooled, dst_stride, out_video->pts_ms);
+    }
+
+    VNEF_LOG("[VIDEO] Returning video buffer %p to caller\n", (void*)dst);
+    fflush(stderr);
+    return 1;
+}
+
+// Repeat detection (skip_repeats): a frame showing the same image as the one
+// converted last skips conversion and hands back the previous output.
+
+// True when b shows the same image as a. Holding a keeps its buffers from
+// being recycled, so a decoder handing back the same buffer settles it;
+// otherwise the planes are compared, which stops at the first differing byte.
+static int frame_unchanged(const AVFrame *a, const AVFrame *b) {
+    if (!a->buf[0] || !b->buf[0]) return 0;
+    if (a->format != b->format || a->width != b->width || a->height != b->height) return 0;
+
+    enum AVPixelFormat fmt = (enum AVPixelFormat)b->format;
+    int same = 1;
+    for (int i = 0; i < 4; i++) {
+        if (a->data[i] != b->data[i] || a->linesize[i] != b->linesize[i]) same = 0;
+    }
+    if (same) return 1;
+
+    int row_bytes[4];
+    ptrdiff_t strides[4];
+    size_t sizes[4];
+    for (int i = 0; i < 4; i++) {
+        if (b->data[i] && (b->linesize[i] <= 0 || a->linesize[i] <= 0 || !a->data[i])) return 0;
+        strides[i] = b->linesize[i];
+    }
+    if (av_image_fill_linesizes(row_bytes, fmt, b->width) < 0) return 0;
+    if (av_image_fill_plane_sizes(sizes, fmt, b->height, strides) < 0) return 0;
+
+    for (int i = 0; i < 4 && b->data[i]; i++) {
+        // Palettes and the like have no rows to compare.
+        if (row_bytes[i] <= 0) return 0;
+        int rows = (int)(sizes[i] / (size_t)b->linesize[i]);
+        for (int y = 0; y < rows; y++) {
+            if (memcmp(a->data[i] + (size_t)y * a->linesize[i], b->data[i] + (size_t)y * b->linesize[i], (size_t)row_bytes[i]) != 0) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static void repeat_reset(VNEVideo *v) {
+    if (v->vprev) av_frame_unref(v->vprev);
+    if (v->last_out_pooled) vne_pool_release(v->last_out);
+    v->last_out = NULL;
+    v->last_out_pooled = 0;
+}
+
+// Keeps the frame just converted (moved out of v->vframe) and its output.
+static void repeat_remember(VNEVideo *v, const VNEVideoTarget *vt) {
+    if (!v->vprev && !(v->vprev = av_frame_alloc())) return;
+
+    repeat_reset(v);
+    av_frame_move_ref(v->vprev, v->vframe);
+    v->last_out = vt->rgba->data;
+    v->last_out_stride = vt->rgba->stride;
+    v->last_out_pooled = vt->dst == NULL;
+    if (v->last_out_pooled) vne_pool_ref(v->last_out);
+}
+
+static int emit_repeat(VNEVideo *v, const VNEVideoTarget *vt) {
+    if (!v->vprev || !v->last_out) return 0;
+    // A caller buffer only still holds the image if it is the one written last.
+    if (vt->dst) {
+        if (v->last_out_pooled || vt->dst != v->last_out || vt->dst_stride != v->last_out_stride) return 0;
+    } else if (!v->last_out_pooled) {
+        return 0;
+    }
+    if (!frame_unchanged(v->vprev, v->vframe)) return 0;
+
+    VNEVideoFrame *out_video = vt->rgba;
+    if (v->last_out_pooled) vne_pool_ref(v->last_out);
+    out_video->width = v->out_w;
+    out_video->height = v->out_h;
+    out_video->stride = v->last_out_stride;
+    out_video->data = v->last_out;
+    out_video->pts_ms = pts_to_ms(v->vstream, v->vframe->best_effort_timestamp);
+    out_video->repeat = 1;
+    if (v->last_out_pooled && v->opts.frame_cache_bytes > 0) {
+        frame_cache_insert(v, v->last_out, v->last_out_stride, out_video->pts_ms);
+    }
+    VNEF_LOG("[VIDEO] Repeat of buffer %p, conversion skipped\n", (void*)v->last_out);
+    return 1;
+}
+
+// Receives the next video frame into v->vframe, dropping frames before an
+// accurate-seek target.
+static int receive_video_frame(VNEVideo *v) {
+    int ret;
+    for (;;) {
+        ret = avcodec_receive_frame(v->vdec, v->vframe);
+        if (ret < 0 || v->video_skip_ms == AV_NOPTS_VALUE) break;
+
+        // Accurate seek: frames before the target are dropped before any
+        // conversion work is spent on them.
+        int64_t pts = pts_to_ms(v->vstream, v->vframe->best_effort_timestamp);
+        if (pts < 0 || pts >= v->video_skip_ms) {
+            v->video_skip_ms = AV_NOPTS_VALUE;
+            break;
+        }
+        VNEF_LOG("[VIDEO] Seek skip pts=%lld\n", (long long)pts);
+        av_frame_unref(v->vframe);
+    }
+    return ret;
+}
+
+// Converts (or passes through) the frame in v->vframe into vt. Pooled and
+// caller-buffer paths do not allocate once the pool has warmed up.
+static int emit_video_frame(VNEVideo *v, const VNEVideoTarget *vt) {
+    int width = v->vframe->width;
+    int height = v->vframe->height;
+    enum AVPixelFormat fmt = (enum AVPixelFormat)v->vframe->format;
+
+    if (width <= 0 || height <= 0) {
+        set_error(v, "invalid video frame size");
+        av_frame_unref(v->vframe);
+        return -1;
+    }
+
+    if (vt->planar && is_native_planar(v, fmt) && width == v->out_w && height == v->out_h) {
+        return emit_native_planar(v, vt->planar);
+    }
+
+    int repeats = v->opts.skip_repeats && vt->rgba;
+    if (repeats && emit_repeat(v, vt)) {
+        av_frame_unref(v->vframe);
+        return 1;
+    }
+
+    if (ensure_sws(v, width, height, fmt) < 0) {
+        av_frame_unref(v->vframe);
+        return -1;
+    }
+
+    int ret = vt->planar ? emit_converted_planar(v, vt->planar) : emit_rgba(v, vt);
+    if (ret == 1 && repeats) repeat_remember(v, vt);
+    av_frame_unref(v->vframe);
+    return ret;
+}
+
+static int try_receive_video(VNEVideo *v, const VNEVideoTarget *vt) {
+    if (!v->vdec || !vt) return 0;
+
+    VNEF_LOG("[VIDEO] Entering try_receive_video\n");
+    fflush(stderr);
+
+    int ret = receive_video_frame(v);
+    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+        VNEF_LOG("[VIDEO] No frame available (EAGAIN or EOF)\n");
+        fflush(stderr);
+        return 0;
+    }
+    if (ret < 0) {
+        set_ff_error(v, ret, "video receive_frame failed");
+        return -1;
+    }
+
+    VNEF_LOG("[VIDEO] Got video frame\n");
+    fflush(stderr);
+    return emit_video_frame(v, vt);
+}
+
+// Receives the next audio frame into v->aframe, dropping frames that end
+// before an accurate-seek target.
+static int receive_audio_frame(VNEVideo *v) {
+    int ret;
+    for (;;) {
+        ret = avcodec_receive_frame(v->adec, v->aframe);
+        if (ret < 0 || v->audio_skip_ms == AV_NOPTS_VALUE) break;
+
+        // Accurate seek: frames that end before the target skip resampling.
+        int64_t pts = pts_to_ms(v->astream, v->aframe->best_effort_timestamp);
+        int rate = v->aframe->sample_rate > 0 ? v->aframe->sample_rate : v->adec->sample_rate;
+        int64_t end = rate > 0 ? pts + (int64_t)v->aframe->nb_samples * 1000 / rate : pts;
+        if (pts < 0 || end > v->audio_skip_ms) {
+            v->audio_skip_ms = AV_NOPTS_VALUE;
+            break;
+        }
+        av_frame_unref(v->aframe);
+    }
+    return ret;
+}
+
+// Never written: a non-NULL input with a count of 0 drains what the resampler
+// holds back, where NULL would flush (and end) the resampling.
+static const uint8_t *vne_no_input[VNE_MAX_AUDIO_CHANNELS];
+
+static unsigned sring_read_pos(VNESampleRing *r) {
+    unsigned head = (unsigned)vne_atomic_load(&r->head);
+    unsigned flush = (unsigned)vne_atomic_load(&r->flush);
+    return (int)(flush - head) > 0 ? flush : head;
+}
+
+static unsigned sring_space(VNESampleRing *r) {
+    return r->capacity - ((unsigned)vne_atomic_load(&r->tail) - sring_read_pos(r));
+}
+
+// Resamples into the ring, at most up to the free space; whatever does not
+// fit stays buffered in swr for the next call.
+static int sring_convert(VNEVideo *v, const uint8_t **in, int in_count) {
+    VNESampleRing *r = &v->sring;
+    unsigned tail = (unsigned)vne_atomic_load(&r->tail);
+    unsigned space = sring_space(r);
+    if (!in) in = vne_no_input;
+
+    while (space > 0) {
+        unsigned pos = tail & r->mask;
+        unsigned chunk = r->capacity - pos;
+        if (chunk > space) chunk = space;
+        uint8_t *out = r->data + (size_t)pos * (size_t)r->frame_bytes;
+
+        int n = swr_convert(v->swr, &out, (int)chunk, in, in_count);
+        if (n < 0) return n;
+        tail += (unsigned)n;
+        space -= (unsigned)n;
+        vne_atomic_store(&r->tail, (int)tail);
+
+        in = vne_no_input;
+        in_count = 0;
+        if ((unsigned)n < chunk) break;
+    }
+    return 0;
+}
+
+// Audio ring mode: drains the decoder into the ring while it has room for a
+// whole frame. Frames left in the decoder make it refuse packets, which
+// next_frame then parks until the reader catches up.
+static int fill_audio_ring(VNEVideo *v) {
+    VNESampleRing *r = &v->sring;
+    for (;;) {
+        int ret = sring_convert(v, NULL, 0);
+        if (ret < 0) {
+            set_ff_error(v, ret, "swr_convert failed");
+            return -1;
+        }
+        if (sring_space(r) < (unsigned)v->audio_max_samples) return 0;
+
+        ret = receive_audio_frame(v);
+        if (ret == AVERROR_EOF) {
+            vne_atomic_store(&r->ended, 1);
+            return 0;
+        }
+        if (ret == AVERROR(EAGAIN)) return 0;
+        if (ret < 0) {
+            set_ff_error(v, ret, "audio receive_frame failed");
+            return -1;
+        }
+
+        ret = sring_convert(v, (const uint8_t **)v->aframe->data, v->aframe->nb_samples);
+        av_frame_unref(v->aframe);
+        if (ret < 0) {
+            set_ff_error(v, ret, "swr_convert failed");
+            return -1;
+        }
+    }
+}
+
+static int try_receive_audio(VNEVideo *v, VNEAudioFrame *out_audio) {
+    if (!v->adec) return 0;
+    if (v->sring.data) return fill_audio_ring(v);
+    if (!out_audio) return 0;
+
+    int ret = receive_audio_frame(v);
+    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+        return 0;
+    }
+    if (ret < 0) {
+        set_ff_error(v, ret, "audio receive_frame failed");
+        return -1;
+    }
+
+    int channels = v->out_channels;
+    int samples = v->aframe->nb_samples;
+    
+    VNEF_LOG("[AUDIO] Received frame: samples=%d channels=%d fmt=%s\n",
+            samples, channels, av_get_sample_fmt_name(v->adec->sample_fmt));
+    fflush(stderr);
+    
+    if (samples <= 0 || channels <= 0) {
+        set_error(v, "invalid audio frame: samples or channels <= 0");
+        av_frame_unref(v->aframe);
+        return -1;
+    }
+
+    // A frame larger than the stream advertised grows the pool's size class;
+    // in steady state the capacity computed at open is reused as-is.
+    int needed = swr_get_out_samples(v->swr, samples);
+    if (needed > v->audio_max_samples) {
+        VNEF_LOG("[AUDIO] Growing buffer capacity %d -> %d samples\n", v->audio_max_samples, needed);
+        v->audio_max_samples = needed;
+    }
+
+    size_t frame_bytes = (size_t)channels * (size_t)v->out_bytes_per_sample;
+    uint8_t *out_buf = vne_pool_get(v->apool, frame_bytes * (size_t)v->audio_max_samples);
+    if (!out_buf) {
+        set_error(v, "failed to allocate audio output buffer");
+        av_frame_unref(v->aframe);
+        return -1;
+    }
+
+    // Planar output keeps each channel in its own plane of the one buffer.
+    uint8_t *out_ptrs[VNE_MAX_AUDIO_CHANNELS] = { out_buf };
+    int plane_stride = 0;
+    if (av_sample_fmt_is_planar(v->out_sample_fmt)) {
+        plane_stride = v->audio_max_samples * v->out_bytes_per_sample;
+        for (int c = 1; c < channels; c++) {
+            out_ptrs[c] = out_buf + (size_t)c * (size_t)plane_stride;
+        }
+    }
+
+    // Convert/resample
+    int converted = swr_convert(
+        v->swr,
+        out_ptrs,
+        v->audio_max_samples,
+        (const uint8_t **)v->aframe->data,
+        samples
+    );
+
+    if (converted < 0) {
+        VNEF_LOG("[AUDIO] swr_convert failed, releasing %p\n", (void*)out_buf);
+        set_ff_error(v, converted, "swr_convert failed");
+        vne_pool_release(out_buf);
+        av_frame_unref(v->aframe);
+        return -1;
+    }
+
+    if (converted == 0) {
+        // The resampler can hold back a tiny frame entirely; try the next one.
+        VNEF_LOG("[AUDIO] swr_convert returned 0, releasing %p\n", (void*)out_buf);
+        vne_pool_release(out_buf);
+        av_frame_unref(v->aframe);
+        return try_receive_audio(v, out_audio);
+    }
+    
+    VNEF_LOG("[AUDIO] Converted %d samples\n", converted);
+
+    int64_t best_pts = v->aframe->best_effort_timestamp;
+
+    out_audio->sample_rate = v->out_sample_rate;
+    out_audio->channels = channels;
+    out_audio->nb_samples = converted;
+    out_audio->bytes_per_sample = v->out_bytes_per_sample;
+    out_audio->sample_format = v->opts.audio_format;
+    out_audio->plane_stride = plane_stride;
+    out_audio->data = out_buf;
+    out_audio->pts_ms = pts_to_ms(v->astream, best_pts);
+    
+    VNEF_LOG("[AUDIO] Returning buffer %p to caller\n", (void*)out_buf);
+    fflush(stderr);
+
+    av_frame_unref(v->aframe);
+    return 1;
+}
+
+// av_read_frame plus loop mode. At the end of the clip the demuxer jumps back
+// to the start without flushing the decoders, so there is no re-priming stall
+// or audio gap, and packet timestamps are shifted by the clip length so pts
+// keeps increasing (the decoders see a continuous stream too).
+static int read_packet(VNEVideo *v, AVPacket *pkt) {
+    int looped = 0;
+    for (;;) {
+        int ret = av_read_frame(v->fmt, pkt);
+        // The clip is measured from where the wrap seeks to, not from the
+        // first packet read, which a seek before playback may have skipped.
+        int64_t start = v->fmt->start_time != AV_NOPTS_VALUE ? v->fmt->start_time : 0;
+        int64_t start_ms = start / (AV_TIME_BASE / 1000);
+        if (ret == AVERROR_EOF && v->opts.loop && !looped && v->loop_end_ms > start_ms) {
+            if (av_seek_frame(v->fmt, -1, start, AVSEEK_FLAG_BACKWARD) < 0) return ret;
+            v->loop_offset_ms += v->loop_end_ms - start_ms;
+            v->loop_count++;
+            looped = 1;
+            continue;
+        }
+        if (ret < 0 || !v->opts.loop) return ret;
+
+        AVStream *st = v->fmt->streams[pkt->stream_index];
+        if (v->loop_count == 0 && pkt->pts != AV_NOPTS_VALUE) {
+            int64_t dur = pkt->duration;
+            if (dur <= 0 && st->avg_frame_rate.num > 0 && st->avg_frame_rate.den > 0) {
+                dur = av_rescale_q(1, av_inv_q(st->avg_frame_rate), st->time_base);
+            }
+            int64_t end = av_rescale_q(pkt->pts + dur, st->time_base, (AVRational){1, 1000});
+            if (end > v->loop_end_ms) v->loop_end_ms = end;
+        }
+        if (v->loop_offset_ms > 0) {
+            int64_t shift = av_rescale_q(v->loop_offset_ms, (AVRational){1, 1000}, st->time_base);
+            if (pkt->pts != AV_NOPTS_VALUE) pkt->pts += shift;
+            if (pkt->dts != AV_NOPTS_VALUE) pkt->dts += shift;
+        }
+        return 0;
+    }
+}
+
+static int pq_push(VNEPacketQueue *q, AVPacket *src) {
+    if (q->count == VNE_PACKET_QUEUE_SIZE) return AVERROR(EAGAIN);
+    AVPacket *p = av_packet_alloc();
+    if (!p) return AVERROR(ENOMEM);
+    av_packet_move_ref(p, src);
+    q->pkts[(q->head + q->count) % VNE_PACKET_QUEUE_SIZE] = p;
+    q->count++;
+    return 0;
+}
+
+static AVPacket *pq_pop(VNEPacketQueue *q) {
+    if (q->count == 0) return NULL;
+    AVPacket *p = q->pkts[q->head];
+    q->head = (q->head + 1) % VNE_PACKET_QUEUE_SIZE;
+    q->count--;
+    return p;
+}
+
+static void pq_flush(VNEPacketQueue *q) {
+    AVPacket *p;
+    while ((p = pq_pop(q)) != NULL) {
+        av_packet_free(&p);
+    }
+}
+
+// Audio ring mode for the video pulls: moves parked audio packets into the
+// decoder and decoded audio into the ring, as far as the ring has room.
+static int pump_audio_ring(VNEVideo *v) {
+    for (;;) {
+        if (fill_audio_ring(v) < 0) return -1;
+        if (v->aqueue.count == 0) {
+            if (!v->eof || v->aflushed) return 0;
+            if (avcodec_send_packet(v->adec, NULL) == AVERROR(EAGAIN)) return 0;
+            v->aflushed = 1;
+            continue;
+        }
+        if (avcodec_send_packet(v->adec, v->aqueue.pkts[v->aqueue.head]) == AVERROR(EAGAIN)) return 0;
+        AVPacket *p = pq_pop(&v->aqueue);
+        av_packet_free(&p);
+    }
+}
+
+// Per-stream pull: sends the next packet of one stream to its decoder and
+// parks packets of the other stream. Only the demuxing runs under demux_lock;
+// decoding runs under the caller's stream lock. Returns 1 when a packet (or
+// the end-of-stream flush) was sent, 0 when the other stream's queue is full,
+// AVERROR_EOF once the stream is drained, or another negative error.
+static int feed_stream(VNEVideo *v, int video) {
+    AVCodecContext *dec = video ? v->vdec : v->adec;
+    VNEPacketQueue *own = video ? &v->vqueue : &v->aqueue;
+    VNEPacketQueue *other = video ? &v->aqueue : &v->vqueue;
+    AVPacket *pkt = video ? v->vpkt : v->apkt;
+    int own_index = video ? v->vstream_index : v->astream_index;
+    int other_index = video ? v->astream_index : v->vstream_index;
+    int *flushed = video ? &v->vflushed : &v->aflushed;
+    if (!dec) return AVERROR_EOF;
+
+    int ret = 0;
+    vne_mutex_lock(&v->demux_lock);
+    AVPacket *parked = pq_pop(own);
+    while (!parked) {
+        // With the audio ring there is no audio pull; video feeds it instead.
+        if (video && v->sring.data && v->adec && pump_audio_ring(v) < 0) {
+            ret = -1;
+            break;
+        }
+        if (v->eof) {
+            ret = AVERROR_EOF;
+            break;
+        }
+        if (other_index >= 0 && other->count == VNE_PACKET_QUEUE_SIZE) {
+            // Nobody pulls audio (video-only playback with vne_video_update
+            // or next_video): keep the newest packets in case an audio pull
+            // starts late, but never let them stall video.
+            // Ring handles have a reader in the audio callback instead.
+            if (video && !v->sring.data && !vne_atomic_load(&v->audio_pulled)) {
+                AVPacket *stale = pq_pop(other);
+                av_packet_free(&stale);
+            } else {
+                ret = 0;
+                break;
+            }
+        }
+        ret = read_packet(v, pkt);
+        if (ret == AVERROR_EOF) {
+            v->eof = 1;
+            continue;
+        }
+        if (ret < 0) {
+            set_ff_error(v, ret, "av_read_frame failed");
+            break;
+        }
+        if (pkt->stream_index == own_index) {
+            ret = 1;
+            break;
+        }
+        if (pkt->stream_index == other_index) {
+            ret = pq_push(other, pkt);
+            if (ret < 0) {
+                set_ff_error(v, ret, "failed to queue packet");
+                av_packet_unref(pkt);
+                break;
+            }
+        }
+        av_packet_unref(pkt);
+    }
+    vne_mutex_unlock(&v->demux_lock);
+
+    if (parked) {
+        avcodec_send_packet(dec, parked);
+        av_packet_free(&parked);
+        return 1;
+    }
+    if (ret == 1) {
+        avcodec_send_packet(dec, pkt);
+        av_packet_unref(pkt);
+        return 1;
+    }
+    if (ret == AVERROR_EOF && !*flushed) {
+        *flushed = 1;
+        avcodec_send_packet(dec, NULL);
+        return 1;
+    }
+    return ret;
+}
+
+// Decodes the next video frame into v->vframe without converting it.
+// Returns 1, 0 when the audio queue is full, AVERROR_EOF or another error.
+static int fetch_video_frame(VNEVideo *v) {
+    for (;;) {
+        int ret = receive_video_frame(v);
+        if (ret >= 0) return 1;
+        if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+            set_ff_error(v, ret, "video receive_frame failed");
+            return ret;
+        }
+        ret = feed_stream(v, 1);
+        if (ret <= 0) return ret;
+    }
+}
+
+static VNEFrameType next_frame(VNEVideo *v, const VNEVideoTarget *vt, VNEAudioFrame *out_audio) {
+    VNEF_LOG("[NEXT] vne_video_next called, target=%p out_audio=%p\n", (void*)vt, (void*)out_audio);
+    fflush(stderr);
+
+    for (;;) {
+        VNEF_LOG("[NEXT] Loop iteration: trying video\n");
+        fflush(stderr);
+        int got = try_receive_video(v, vt);
+        if (got == 1) {
+            VNEF_LOG("[NEXT] Returning VIDEO frame\n");
+            fflush(stderr);
+            return VNE_FRAME_VIDEO;
+        }
+        if (got < 0) return VNE_FRAME_ERROR;
+
+        VNEF_LOG("[NEXT] Trying audio\n");
+        fflush(stderr);
+        got = try_receive_audio(v, out_audio);
+        if (got == 1) {
+            VNEF_LOG("[NEXT] Returning AUDIO frame\n");
+            fflush(stderr);
+            return VNE_FRAME_AUDIO;
+        }
+        if (got < 0) return VNE_FRAME_ERROR;
+
+        // Packets parked by the per-stream pulls go first.
+        AVPacket *parked = pq_pop(&v->vqueue);
+        if (parked) {
+            if (v->vdec) avcodec_send_packet(v->vdec, parked);
+            av_packet_free(&parked);
+            continue;
+        }
+        if (v->aqueue.count > 0) {
+            // With the audio ring full the decoder refuses packets; those stay
+            // parked, in order, until the reader makes room. Only a packet the
+            // decoder took leaves the queue.
+            int ret = v->adec ? avcodec_send_packet(v->adec, v->aqueue.pkts[v->aqueue.head]) : 0;
+            if (ret != AVERROR(EAGAIN) || !v->sring.data) {
+                parked = pq_pop(&v->aqueue);
+                av_packet_free(&parked);
+                continue;
+            }
+        }
+
+        if (v->sring.data) {
+            // Nothing to do until the audio reader catches up: no video is
+            // wanted, or too much audio is parked to keep demuxing for it.
+            if (v->aqueue.count == VNE_PACKET_QUEUE_SIZE
+                || ((!vt || !v->vdec) && sring_space(&v->sring) < (unsigned)v->audio_max_samples)) {
+                return VNE_FRAME_NONE;
+            }
+        }
+
+        if (v->eof) {
+            if (v->aqueue.count > 0) return VNE_FRAME_NONE;
+            if (v->vflushed && v->aflushed) {
+                // The ring has the last audio only once the decoder drained.
+                if (v->sring.data && !vne_atomic_load(&v->sring.ended)) return VNE_FRAME_NONE;
+                return VNE_FRAME_EOF;
+            }
+            int flushed_video = 0;
+            if (v->vdec && !v->vflushed) {
+                avcodec_send_packet(v->vdec, NULL);
+                flushed_video = 1;
+            }
+            v->vflushed = 1;
+            if (!v->aflushed) {
+                // A full audio ring refuses the flush as well; it is retried
+                // once the reader makes room.
+                int ret = v->adec ? avcodec_send_packet(v->adec, NULL) : 0;
+                if (ret == AVERROR(EAGAIN) && v->sring.data) {
+                    if (!flushed_video) return VNE_FRAME_NONE;
+                } else {
+                    v->aflushed = 1;
+                }
+            }
+            continue;
+        }
+
+        int ret = read_packet(v, v->pkt);
+        if (ret == AVERROR_EOF) {
+            v->eof = 1;
+            continue;
+        }
+        if (ret < 0) {
+            set_ff_error(v, ret, "av_read_frame failed");
+            return VNE_FRAME_ERROR;
+        }
+
+        if (v->pkt->stream_index == v->vstream_index) {
+            if (v->vdec) avcodec_send_packet(v->vdec, v->pkt);
+            // Without a video target its frames are never converted, so the
+            // cache must not link across them.
+            if (!vt) v->fcache_prev_pts = AV_NOPTS_VALUE;
+        } else if (v->pkt->stream_index == v->astream_index && v->adec) {
+            if (!v->sring.data) {
+                avcodec_send_packet(v->adec, v->pkt);
+            } else if (v->aqueue.count > 0 || avcodec_send_packet(v->adec, v->pkt) == AVERROR(EAGAIN)) {
+                ret = pq_push(&v->aqueue, v->pkt);
+                if (ret < 0) {
+                    set_ff_error(v, ret, "failed to queue packet");
+                    av_packet_unref(v->pkt);
+                    return VNE_FRAME_ERROR;
+                }
+            }
+        }
+
+        av_packet_unref(v->pkt);
+    }
+}
+
+static int ring_init(VNEFrameRing *r, int depth) {
+    unsigned n = 1;
+    while (n < (unsigned)depth) n <<= 1;
+    r->slots = (VNEFrameSlot *)calloc(n, sizeof(VNEFrameSlot));
+    if (!r->slots) return -1;
+    r->mask = n - 1;
+    r->depth = (unsigned)depth;
+    vne_atomic_store(&r->head, 0);
+    vne_atomic_store(&r->tail, 0);
+    return 0;
+}
+
+static unsigned ring_count(VNEFrameRing *r) {
+    return (unsigned)vne_atomic_load(&r->tail) - (unsigned)vne_atomic_load(&r->head);
+}
+
+static int ring_full(VNEFrameRing *r) {
+    return r->slots && ring_count(r) >= r->depth;
+}
+
+// Producer side. The worker checks ring_full before decoding, so there is
+// always room here.
+static void ring_push(VNEFrameRing *r, const VNEFrameSlot *slot) {
+    unsigned tail = (unsigned)vne_atomic_load(&r->tail);
+    r->slots[tail & r->mask] = *slot;
+    vne_atomic_store(&r->tail, (int)(tail + 1));
+}
+
+static VNEFrameSlot *ring_peek(VNEFrameRing *r) {
+    if (!r->slots) return NULL;
+    unsigned head = (unsigned)vne_atomic_load(&r->head);
+    if ((unsigned)vne_atomic_load(&r->tail) == head) return NULL;
+    return &r->slots[head & r->mask];
+}
+
+static void ring_drop(VNEFrameRing *r) {
+    vne_atomic_store(&r->head, (int)((unsigned)vne_atomic_load(&r->head) + 1));
+}
+
+static void ring_drain(VNEFrameRing *r) {
+    VNEFrameSlot *slot;
+    while ((slot = ring_peek(r)) != NULL) {
+        vne_video_free_video_frame(&slot->video);
+        vne_video_free_planar_frame(&slot->planar);
+        vne_video_free_audio_frame(&slot->audio);
+        ring_drop(r);
+    }
+}
+
+static void ring_free(VNEFrameRing *r) {
+    ring_drain(r);
+    free(r->slots);
+    r->slots = NULL;
+}
+
+// One producer step: decodes the next frame into the queues. Returns 1 when a
+// frame was queued, 0 when there is no room (a full queue, or a full audio
+// ring that only drains from the audio callback) and -1 once the stream ended
+// or failed, with the result published in async_state.
+static int async_step(VNEVideo *v) {
+    if (ring_full(&v->vring) || ring_full(&v->aring)) return 0;
+
+    VNEFrameSlot slot;
+    memset(&slot, 0, sizeof(slot));
+    VNEVideoTarget vt = { 0 };
+    if (v->opts.output_format == VNE_PIXEL_RGBA) {
+        vt.rgba = &slot.video;
+    } else {
+        vt.planar = &slot.planar;
+    }
+
+    VNEFrameType t = next_frame(v, &vt, &slot.audio);
+    if (t == VNE_FRAME_VIDEO) {
+        ring_push(&v->vring, &slot);
+        v->sched_tail_ms = vt.planar ? slot.planar.pts_ms : slot.video.pts_ms;
+        return 1;
+    }
+    if (t == VNE_FRAME_AUDIO) {
+        ring_push(&v->aring, &slot);
+        if (!v->vdec) v->sched_tail_ms = slot.audio.pts_ms;
+        return 1;
+    }
+    if (t == VNE_FRAME_NONE) return 0;
+
+    vne_atomic_store(&v->async_state, t);
+    return -1;
+}
+
+static void async_worker(void *arg) {
+    VNEVideo *v = (VNEVideo *)arg;
+
+    while (!vne_atomic_load(&v->async_quit)) {
+        int ret = async_step(v);
+        if (ret < 0) break;
+        if (ret > 0) continue;
+
+        vne_mutex_lock(&v->async_lock);
+        vne_atomic_store(&v->async_waiting, 1);
+        if (!vne_atomic_load(&v->async_quit)) {
+            // The consumer signals without the lock and the audio callback
+            // never signals, so bound the wait instead of relying on wakeups.
+            vne_cond_wait_ms(&v->async_cond, &v->async_lock, 5);
+        }
+        vne_atomic_store(&v->async_waiting, 0);
+        vne_mutex_unlock(&v->async_lock);
+    }
+}
+
+static void sched_pause(VNEVideo *v);
+static void sched_resume(VNEVideo *v);
+static void sched_wake(VNEVideo *v);
+
+static void async_stop(VNEVideo *v) {
+    if (!v->async_running) return;
+    if (v->sched) {
+        sched_pause(v);
+        return;
+    }
+
+    vne_atomic_store(&v->async_quit, 1);
+    vne_mutex_lock(&v->async_lock);
+    vne_cond_broadcast(&v->async_cond);
+    vne_mutex_unlock(&v->async_lock);
+    vne_thread_join(&v->async_thread);
+    v->async_running = 0;
+}
+
+static int async_start(VNEVideo *v) {
+    if (v->sched) {
+        sched_resume(v);
+        return 0;
+    }
+    vne_atomic_store(&v->async_quit, 0);
+    vne_atomic_store(&v->async_waiting, 0);
+    vne_atomic_store(&v->async_state, VNE_FRAME_NONE);
+    if (vne_thread_start(&v->async_thread, async_worker, v) != 0) {
+        set_error(v, "failed to start decode thread");
+        return -1;
+    }
+    v->async_running = 1;
+    return 0;
+}
+
+static void async_wake(VNEVideo *v) {
+    if (v->sched) {
+        sched_wake(v);
+        return;
+    }
+    if (vne_atomic_load(&v->async_waiting)) {
+        vne_cond_signal(&v->async_cond);
+    }
+}
+
+// Consumer side of async mode: hands over the oldest ready frame without
+// blocking. Returns -1 when the rings are empty.
+static int async_pop(VNEVideo *v, const VNEVideoTarget *vt, VNEAudioFrame *out_audio, VNEFrameType *out_type) {
+    // A consumer that does not take a stream must not leave the worker
+    // blocked on that stream's full ring.
+    if (!vt) ring_drain(&v->vring);
+    if (!out_audio) ring_drain(&v->aring);
+
+    VNEFrameSlot *vs = vt ? ring_peek(&v->vring) : NULL;
+    VNEFrameSlot *as = out_audio ? ring_peek(&v->aring) : NULL;
+
+    if (vs && as) {
+        int64_t vpts = vt->planar ? vs->planar.pts_ms : vs->video.pts_ms;
+        if (as->audio.pts_ms < vpts) {
+            vs = NULL;
+        } else {
+            as = NULL;
+        }
+    }
+
+    if (vs) {
+        if (vt->planar) {
+            *vt->planar = vs->planar;
+        } else {
+            *vt->rgba = vs->video;
+        }
+        ring_drop(&v->vring);
+        *out_type = VNE_FRAME_VIDEO;
+    } else if (as) {
+        *out_audio = as->audio;
+        ring_drop(&v->aring);
+        *out_type = VNE_FRAME_AUDIO;
+    } else {
+        return -1;
+    }
+
+    async_wake(v);
+    return 0;
+}
+
+static VNEFrameType next_any(VNEVideo *v, const VNEVideoTarget *vt, VNEAudioFrame *out_audio) {
+    if (v->vring.slots) {
+        // Read the worker state before the rings: everything it queued
+        // happened before it published EOF or ERROR.
+        int state = v->async_running ? vne_atomic_load(&v->async_state) : VNE_FRAME_NONE;
+        VNEFrameType t;
+        if (async_pop(v, vt, out_audio, &t) == 0) return t;
+        if (v->async_running) {
+            return state == VNE_FRAME_NONE ? VNE_FRAME_NONE : (VNEFrameType)state;
+        }
+    }
+
+    return next_frame(v, vt, out_audio);
+}
+
+VNEFrameType vne_video_next(VNEVideo *v, VNEVideoFrame *out_video, VNEAudioFrame *out_audio) {
+    if (!v) return VNE_FRAME_ERROR;
+    if (v->opts.output_format != VNE_PIXEL_RGBA) {
+        set_error(v, "handle uses planar output; call vne_video_next_planar");
+        return VNE_FRAME_ERROR;
+    }
+
+    VNEVideoTarget vt = { out_video, NULL, NULL, 0 };
+    return next_any(v, out_video ? &vt : NULL, out_audio);
+}
+
+// Queued audio nobody has asked for yet is dropped by video-only consumers,
+// so the worker never stalls on a full audio queue. The audio lock keeps this
+// from racing the first audio pull.
+static void drop_unread_audio(VNEVideo *v) {
+    if (vne_atomic_load(&v->audio_pulled)) return;
+    vne_mutex_lock(&v->audio_lock);
+    if (!vne_atomic_load(&v->audio_pulled)) ring_drain(&v->aring);
+    vne_mutex_unlock(&v->audio_lock);
+}
+
+static VNEFrameType next_stream(VNEVideo *v, int video, VNEVideoFrame *out_video, VNEAudioFrame *out_audio) {
+    if (!video && !vne_atomic_load(&v->audio_pulled)) {
+        vne_mutex_lock(&v->audio_lock);
+        vne_atomic_store(&v->audio_pulled, 1);
+        vne_mutex_unlock(&v->audio_lock);
+    }
+    if (v->vring.slots) {
+        if (video) drop_unread_audio(v);
+        // Each stream has its own ring, so the two pulls stay single-consumer.
+        VNEFrameRing *r = video ? &v->vring : &v->aring;
+        int state = v->async_running ? vne_atomic_load(&v->async_state) : VNE_FRAME_NONE;
+        VNEFrameSlot *slot = ring_peek(r);
+        if (slot) {
+            if (video) {
+                *out_video = slot->video;
+            } else {
+                *out_audio = slot->audio;
+            }
+            ring_drop(r);
+            async_wake(v);
+            return video ? VNE_FRAME_VIDEO : VNE_FRAME_AUDIO;
+        }
+        if (v->async_running) return (VNEFrameType)state;
+    }
+
+    vne_mutex *lock = video ? &v->video_lock : &v->audio_lock;
+    VNEVideoTarget vt = { out_video, NULL, NULL, 0 };
+    VNEFrameType t;
+
+    vne_mutex_lock(lock);
+    for (;;) {
+        int got = video ? try_receive_video(v, &vt) : try_receive_audio(v, out_audio);
+        if (got == 1) {
+            t = video ? VNE_FRAME_VIDEO : VNE_FRAME_AUDIO;
+            break;
+        }
+        if (got < 0) {
+            t = VNE_FRAME_ERROR;
+            break;
+        }
+
+        int ret = feed_stream(v, video);
+        if (ret == 0) {
+            t = VNE_FRAME_NONE;
+            break;
+        }
+        if (ret < 0) {
+            t = ret == AVERROR_EOF ? VNE_FRAME_EOF : VNE_FRAME_ERROR;
+            break;
+        }
+    }
+    vne_mutex_unlock(lock);
+    return t;
+}
+
+VNEFrameType vne_video_next_video(VNEVideo *v, VNEVideoFrame *out_video) {
+    if (!v || !out_video) return VNE_FRAME_ERROR;
+    if (v->opts.output_format != VNE_PIXEL_RGBA) {
+        set_error(v, "handle uses planar output; call vne_video_next_planar");
+        return VNE_FRAME_ERROR;
+    }
+    return next_stream(v, 1, out_video, NULL);
+}
+
+// While playback keeps falling behind, trade picture quality for decode
+// speed: 1 skips the loop filter on non-reference frames, 2 on all frames,
+// 3 also skips decoding non-reference frames.
+#define VNE_LAG_RAISE_UPDATES 3  // updates in a row with drops before stepping up
+#define VNE_LAG_CLEAR_UPDATES 60 // updates in a row without drops before stepping down
+#define VNE_LAG_MAX_LEVEL 3
+
+static void set_lag_level(VNEVideo *v, int level) {
+    static const enum AVDiscard loop_filter[VNE_LAG_MAX_LEVEL + 1] = {
+        AVDISCARD_DEFAULT, AVDISCARD_NONREF, AVDISCARD_ALL, AVDISCARD_ALL
+    };
+    v->lag_level = level;
+    v->lag_calls = 0;
+    v->vdec->skip_loop_filter = loop_filter[level];
+    v->vdec->skip_frame = level >= 3 ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+}
+
+static void track_lag(VNEVideo *v, int dropped) {
+    if (dropped > 0) {
+        v->lag_calls = v->lag_calls > 0 ? v->lag_calls + 1 : 1;
+        if (v->lag_calls >= VNE_LAG_RAISE_UPDATES && v->lag_level < VNE_LAG_MAX_LEVEL) {
+            set_lag_level(v, v->lag_level + 1);
+        }
+    } else {
+        v->lag_calls = v->lag_calls < 0 ? v->lag_calls - 1 : -1;
+        if (v->lag_calls <= -VNE_LAG_CLEAR_UPDATES && v->lag_level > 0) {
+            set_lag_level(v, v->lag_level - 1);
+        }
+    }
+}
+
+VNEFrameType vne_video_update(VNEVideo *v, int64_t now_ms, VNEVideoFrame *out_video, int *out_dropped) {
+    if (out_dropped) *out_dropped = 0;
+    if (!v || !out_video) return VNE_FRAME_ERROR;
+    if (v->opts.output_format != VNE_PIXEL_RGBA) {
+        set_error(v, "handle uses planar output; call vne_video_next_planar");
+        return VNE_FRAME_ERROR;
+    }
+    if (!v->vdec) {
+        set_error(v, "handle has no video stream");
+        return VNE_FRAME_ERROR;
+    }
+
+    int dropped = 0;
+    int have = 0;
+
+    if (v->vring.slots) {
+        // The worker has converted these already; dropping still lets the
+        // consumer catch up in one call.
+        drop_unread_audio(v);
+        int state = v->async_running ? vne_atomic_load(&v->async_state) : VNE_FRAME_NONE;
+        VNEFrameSlot *slot;
+        while ((slot = ring_peek(&v->vring)) != NULL && slot->video.pts_ms <= now_ms) {
+            if (have) {
+                vne_video_free_video_frame(out_video);
+                dropped++;
+            }
+            *out_video = slot->video;
+            have = 1;
+            ring_drop(&v->vring);
+        }
+        if (have || slot || v->async_running) {
+            if (have) async_wake(v);
+            // A repeat of a dropped frame is not a repeat of what is on screen.
+            if (dropped) out_video->repeat = 0;
+            if (out_dropped) *out_dropped = dropped;
+            return have ? VNE_FRAME_VIDEO : slot ? VNE_FRAME_NONE : (VNEFrameType)state;
+        }
+    }
+
+    VNEFrameType t;
+    int status = 0;
+    vne_mutex_lock(&v->video_lock);
+    for (;;) {
+        // Decode one frame ahead and hold it until the clock reaches it.
+        if (!v->vnext_valid) {
+            status = fetch_video_frame(v);
+            if (status != 1) break;
+            av_frame_move_ref(v->vnext, v->vframe);
+            v->vnext_valid = 1;
+        }
+        if (pts_to_ms(v->vstream, v->vnext->best_effort_timestamp) > now_ms) {
+            status = 0;
+            break;
+        }
+        // A newer frame is due too: drop the older one before conversion.
+        if (have) {
+            av_frame_unref(v->vdue);
+            v->fcache_prev_pts = AV_NOPTS_VALUE;
+            dropped++;
+        }
+        av_frame_move_ref(v->vdue, v->vnext);
+        v->vnext_valid = 0;
+        have = 1;
+    }
+
+    if (have) {
+        VNEVideoTarget vt = { out_video, NULL, NULL, 0 };
+        av_frame_move_ref(v->vframe, v->vdue);
+        t = emit_video_frame(v, &vt) == 1 ? VNE_FRAME_VIDEO : VNE_FRAME_ERROR;
+    } else if (status == AVERROR_EOF) {
+        t = VNE_FRAME_EOF;
+    } else {
+        t = status < 0 ? VNE_FRAME_ERROR : VNE_FRAME_NONE;
+    }
+    track_lag(v, dropped);
+    vne_mutex_unlock(&v->video_lock);
+
+    if (out_dropped) *out_dropped = dropped;
+    return t;
+}
+
+VNEFrameType vne_video_next_audio(VNEVideo *v, VNEAudioFrame *out_audio) {
+    if (!v || !out_audio) return VNE_FRAME_ERROR;
+    if (v->sring.data) {
+        set_error(v, "handle uses the audio ring; call vne_video_read_audio");
+        return VNE_FRAME_ERROR;
+    }
+    return next_stream(v, 0, NULL, out_audio);
+}
+
+VNEFrameType vne_video_next_planar(VNEVideo *v, VNEPlanarFrame *out_video, VNEAudioFrame *out_audio) {
+    if (!v) return VNE_FRAME_ERROR;
+    if (v->opts.output_format == VNE_PIXEL_RGBA) {
+        set_error(v, "handle uses RGBA output; call vne_video_next");
+        return VNE_FRAME_ERROR;
+    }
+
+    VNEVideoTarget vt = { NULL, out_video, NULL, 0 };
+    return next_any(v, out_video ? &vt : NULL, out_audio);
+}
+
+static int async_rings(VNEVideo *v, int queue_depth) {
+    if (queue_depth <= 0) queue_depth = 8;
+
+    // Resizing would drop queued frames (e.g. from a preload), so only an
+    // empty queue takes the new depth.
+    if (v->vring.slots && (int)v->vring.depth != queue_depth && !ring_peek(&v->vring) && !ring_peek(&v->aring)) {
+        ring_free(&v->vring);
+        ring_free(&v->aring);
+    }
+    if (!v->vring.slots) {
+        if (ring_init(&v->vring, queue_depth) < 0 || ring_init(&v->aring, queue_depth) < 0) {
+            ring_free(&v->vring);
+            ring_free(&v->aring);
+            set_error(v, "out of memory for frame queue");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int vne_video_start_async(VNEVideo *v, int queue_depth) {
+    if (!v) return -1;
+    if (v->async_running) return 0;
+    if (async_rings(v, queue_depth) < 0) return -1;
+
+    if (!v->async_sync_init) {
+        vne_mutex_init(&v->async_lock);
+        vne_cond_init(&v->async_cond);
+        v->async_sync_init = 1;
+    }
+
+    return async_start(v);
+}
+
+void vne_video_stop_async(VNEVideo *v) {
+    if (!v) return;
+    async_stop(v);
+}
+
+VNEFrameType vne_video_next_into(VNEVideo *v, uint8_t *dst, int dst_stride, VNEVideoFrame *out_video, VNEAudioFrame *out_audio) {
+    if (!v) return VNE_FRAME_ERROR;
+    if (v->opts.output_format != VNE_PIXEL_RGBA) {
+        set_error(v, "handle uses planar output; call vne_video_next_planar");
+        return VNE_FRAME_ERROR;
+    }
+    if (!dst || dst_stride < v->out_w * 4) {
+        set_error(v, "destination buffer is NULL or stride is too small");
+        return VNE_FRAME_ERROR;
+    }
+    if (v->async_running) {
+        set_error(v, "vne_video_next_into is not available in async mode");
+        return VNE_FRAME_ERROR;
+    }
+
+    // Frames queued earlier (a preload, or a stopped async run) go out
+    // first; video ones are copied into dst.
+    if (ring_peek(&v->vring) || ring_peek(&v->aring)) {
+        VNEVideoFrame queued = { 0 };
+        VNEVideoTarget qt = { &queued, NULL, NULL, 0 };
+        VNEFrameType t;
+        if (async_pop(v, out_video ? &qt : NULL, out_audio, &t) == 0) {
+            if (t == VNE_FRAME_VIDEO) {
+                av_image_copy_plane(dst, dst_stride, queued.data, queued.stride, queued.width * 4, queued.height);
+                *out_video = queued;
+                out_video->data = dst;
+                out_video->stride = dst_stride;
+                out_video->repeat = 0;
+                vne_video_free_video_frame(&queued);
+            }
+            return t;
+        }
+    }
+
+    VNEVideoTarget vt = { out_video, NULL, dst, dst_stride };
+    return next_frame(v, out_video ? &vt : NULL, out_audio);
+}
+
+void vne_video_free_video_frame(VNEVideoFrame *f) {
+    if (!f) return;
+    VNEF_LOG("[VIDEO] Releasing video frame buffer %p\n", (void*)f->data);
+    fflush(stderr);
+    vne_pool_release(f->data);
+    f->data = NULL;
+    f->width = 0;
+    f->height = 0;
+    f->stride = 0;
+    f->pts_ms = 0;
+    f->repeat = 0;
+}
+
+void vne_video_free_planar_frame(VNEPlanarFrame *f) {
+    if (!f) return;
+    if (f->priv) {
+        AVFrame *ref = (AVFrame *)f->priv;
+        av_frame_free(&ref);
+    } else {
+        vne_pool_release(f->planes[0]);
+    }
+    memset(f, 0, sizeof(*f));
+}
+
+void vne_video_free_audio_frame(VNEAudioFrame *f) {
+    if (!f) return;
+    if (f->data) {
+        VNEF_LOG("[AUDIO] Releasing audio frame buffer %p\n", (void*)f->data);
+        vne_pool_release(f->data);
+    }
+    f->data = NULL;
+    f->sample_rate = 0;
+    f->channels = 0;
+    f->nb_samples = 0;
+    f->bytes_per_sample = 0;
+    f->sample_format = 0;
+    f->plane_stride = 0;
+    f->pts_ms = 0;
+}
+
+int vne_video_read_audio(VNEVideo *v, void *dst, int nb_samples) {
+    if (!v || !v->sring.data || !dst || nb_samples <= 0) return 0;
+
+    VNESampleRing *r = &v->sring;
+    unsigned head = sring_read_pos(r);
+    unsigned avail = (unsigned)vne_atomic_load(&r->tail) - head;
+    unsigned n = avail < (unsigned)nb_samples ? avail : (unsigned)nb_samples;
+
+    unsigned pos = head & r->mask;
+    unsigned first = r->capacity - pos;
+    if (first > n) first = n;
+    uint8_t *out = (uint8_t *)dst;
+    memcpy(out, r->data + (size_t)pos * (size_t)r->frame_bytes, (size_t)first * (size_t)r->frame_bytes);
+    memcpy(out + (size_t)first * (size_t)r->frame_bytes, r->data, (size_t)(n - first) * (size_t)r->frame_bytes);
+    vne_atomic_store(&r->head, (int)(head + n));
+
+    if (n < (unsigned)nb_samples && !vne_atomic_load(&r->ended)) {
+        vne_atomic_store(&r->underruns, vne_atomic_load(&r->underruns) + 1);
+    }
+    return (int)n;
+}
+
+int vne_video_audio_underruns(VNEVideo *v) {
+    return v ? vne_atomic_load(&v->sring.underruns) : 0;
+}
+
+int vne_video_seek_ms(VNEVideo *v, int64_t target_ms) {
+    return vne_video_seek_ex(v, target_ms, 0);
+}
+
+// Moves the demuxer to the keyframe at or before target_ms and resets all
+// decode state behind it. The async worker must already be stopped.
+static int seek_to(VNEVideo *v, int64_t target_ms) {
+    // Audio-only handles seek on the audio stream.
+    AVStream *st = v->vstream ? v->vstream : v->astream;
+    if (!st) return -1;
+
+    int64_t ts = av_rescale_q(target_ms, (AVRational){1, 1000}, st->time_base);
+    int ret = av_seek_frame(v->fmt, st->index, ts, AVSEEK_FLAG_BACKWARD);
+    if (ret < 0) {
+        set_ff_error(v, ret, "av_seek_frame failed");
+        return -1;
+    }
+
+    if (v->vdec) avcodec_flush_buffers(v->vdec);
+    if (v->adec) avcodec_flush_buffers(v->adec);
+    pq_flush(&v->vqueue);
+    pq_flush(&v->aqueue);
+    if (v->vnext) av_frame_unref(v->vnext);
+    if (v->vdue) av_frame_unref(v->vdue);
+    v->vnext_valid = 0;
+    if (v->vdec) set_lag_level(v, 0);
+    if (v->sring.data) {
+        // The reader may be mid-copy, so the producer cannot move head; it
+        // marks everything queued so far as stale and the reader skips it.
+        swr_init(v->swr);
+        vne_atomic_store(&v->sring.flush, vne_atomic_load(&v->sring.tail));
+        vne_atomic_store(&v->sring.ended, 0);
+    }
+    v->loop_offset_ms = 0;
+    v->fcache_prev_pts = AV_NOPTS_VALUE;
+    repeat_reset(v);
+    v->eof = 0;
+    v->vflushed = 0;
+    v->aflushed = 0;
+    return 0;
+}
+
+int vne_video_seek_ex(VNEVideo *v, int64_t target_ms, int flags) {
+    if (!v) return -1;
+
+    // Queued frames belong to the old position; the worker restarts below.
+    int resume = v->async_running;
+    async_stop(v);
+    ring_drain(&v->vring);
+    ring_drain(&v->aring);
+
+    if (seek_to(v, target_ms) < 0) {
+        if (resume) async_start(v);
+        return -1;
+    }
+
+    if (flags & VNE_SEEK_ACCURATE) {
+        v->video_skip_ms = target_ms;
+        v->audio_skip_ms = target_ms;
+    } else {
+        v->video_skip_ms = AV_NOPTS_VALUE;
+        v->audio_skip_ms = AV_NOPTS_VALUE;
+    }
+
+    if (resume && async_start(v) < 0) return -1;
+    return 0;
+}
+
+// A handle tuned for keyframe grabs: no audio, output fitted to the box,
+// slice threads only (frame threads would hold each keyframe back).
+static VNEVideo *open_thumbnailer(const char *path, int max_w, int max_h, VNEVideoInfo *info) {
+    if (!path || max_w <= 0 || max_h <= 0) return NULL;
+
+    VNEOpenOptions opts;
+    vne_video_default_options(&opts);
+    opts.disable_audio = 1;
+    opts.video_thread_type = VNE_THREAD_SLICE;
+    opts.allow_lowres = 1;
+
+    VNEVideo *v = vne_video_create(&opts);
+    if (!v) return NULL;
+    v->fit_w = max_w;
+    v->fit_h = max_h;
+
+    v = open_path(v, path, info);
+    if (!v) return NULL;
+    if (!v->vdec) {
+        vne_video_close(v);
+        return NULL;
+    }
+    v->vdec->skip_frame = AVDISCARD_NONKEY;
+    return v;
+}
+
+// Decodes the keyframe at or before time_ms into a pooled RGBA frame. Only
+// that one packet reaches the decoder, which is drained right away so codecs
+// with frame reordering hand it out without waiting for more input.
+static int grab_keyframe(VNEVideo *v, int64_t time_ms, VNEVideoFrame *out) {
+    int64_t ts = av_rescale_q(time_ms, (AVRational){1, 1000}, v->vstream->time_base);
+    int ret = av_seek_frame(v->fmt, v->vstream_index, ts, AVSEEK_FLAG_BACKWARD);
+    if (ret < 0 && time_ms > 0) {
+        set_ff_error(v, ret, "av_seek_frame failed");
+        return -1;
+    }
+    avcodec_flush_buffers(v->vdec);
+
+    for (;;) {
+        ret = av_read_frame(v->fmt, v->pkt);
+        if (ret < 0) {
+            set_ff_error(v, ret, "no keyframe found");
+            return -1;
+        }
+        if (v->pkt->stream_index == v->vstream_index && (v->pkt->flags & AV_PKT_FLAG_KEY)) break;
+        av_packet_unref(v->pkt);
+    }
+
+    ret = avcodec_send_packet(v->vdec, v->pkt);
+    av_packet_unref(v->pkt);
+    if (ret >= 0) ret = avcodec_send_packet(v->vdec, NULL);
+    if (ret >= 0) ret = avcodec_receive_frame(v->vdec, v->vframe);
+    if (ret < 0) {
+        set_ff_error(v, ret, "keyframe decode failed");
+        avcodec_flush_buffers(v->vdec);
+        return -1;
+    }
+
+    VNEVideoTarget vt = { out, NULL, NULL, 0 };
+    ret = emit_video_frame(v, &vt);
+    avcodec_flush_buffers(v->vdec);
+    return ret == 1 ? 0 : -1;
+}
+
+int vne_video_thumbnail(const char *path, int64_t time_ms, int max_w, int max_h, VNEVideoFrame *out) {
+    if (!out) return -1;
+    memset(out, 0, sizeof(*out));
+
+    VNEVideo *v = open_thumbnailer(path, max_w, max_h, NULL);
+    if (!v) return -1;
+    int ret = grab_keyframe(v, time_ms > 0 ? time_ms : 0, out);
+    vne_video_close(v);
+    return ret;
+}
+
+int vne_video_thumbnails(const char *path, int count, int max_w, int max_h, VNEVideoFrame *out) {
+    if (!out || count <= 0) return -1;
+    memset(out, 0, sizeof(*out) * (size_t)count);
+
+    VNEVideoInfo info;
+    VNEVideo *v = open_thumbnailer(path, max_w, max_h, &info);
+    if (!v) return -1;
+
+    // Segment midpoints, in order, so the seeks only ever move forward.
+    if (info.duration_ms <= 0) count = 1;
+    int n = 0;
+    for (; n < count; n++) {
+        int64_t t = info.duration_ms * (2 * n + 1) / (2 * (int64_t)count);
+        if (grab_keyframe(v, t, &out[n]) < 0) break;
+    }
+    vne_video_close(v);
+    return n;
+}
+
+// Scrubs forward by decoding on instead of seeking when the target is at most
+// this far past the frame converted last.
+#define VNE_SCRUB_FORWARD_MS 1000
+
+static void hand_out_cached(VNEVideo *v, VNECachedFrame *e, VNEVideoFrame *out) {
+    vne_pool_ref(e->data);
+    out->width = v->out_w;
+    out->height = v->out_h;
+    out->stride = FFALIGN(v->out_w * 4, 64);
+    out->data = e->data;
+    out->pts_ms = e->pts_ms;
+    out->repeat = 0;
+    v->scrub_pts_ms = e->pts_ms;
+}
+
+// Cache miss: decodes from the keyframe at or before target_ms up to the
+// target, converting (and so caching) every frame on the way. Stepping back
+// through that GOP is then served from memory.
+static VNEFrameType decode_to(VNEVideo *v, int64_t target_ms, VNEVideoFrame *out) {
+    int64_t prev = v->fcache_prev_pts;
+    if (prev == AV_NOPTS_VALUE || target_ms < prev || target_ms - prev > VNE_SCRUB_FORWARD_MS) {
+        if (seek_to(v, target_ms) < 0) return VNE_FRAME_ERROR;
+    }
+
+    VNEVideoTarget vt = { out, NULL, NULL, 0 };
+    for (;;) {
+        int ret = receive_video_frame(v);
+        if (ret >= 0) {
+            if (emit_video_frame(v, &vt) != 1) return VNE_FRAME_ERROR;
+            if (out->pts_ms < target_ms) {
+                vne_video_free_video_frame(out);
+                continue;
+            }
+            // Past the target: the frame before it is the one on screen.
+            VNECachedFrame *e = out->pts_ms > target_ms ? frame_cache_lookup(v, target_ms) : NULL;
+            if (e) {
+                vne_video_free_video_frame(out);
+                hand_out_cached(v, e, out);
+            } else {
+                v->scrub_pts_ms = out->pts_ms;
+            }
+            return VNE_FRAME_VIDEO;
+        }
+        if (ret == AVERROR_EOF) {
+            // The last frame stays on screen from here to the end.
+            VNECachedFrame *e = v->fcache_prev_pts != AV_NOPTS_VALUE ? frame_cache_find(v, v->fcache_prev_pts) : NULL;
+            if (e) e->next_pts_ms = INT64_MAX;
+            e = frame_cache_lookup(v, target_ms);
+            if (!e) return VNE_FRAME_EOF;
+            hand_out_cached(v, e, out);
+            return VNE_FRAME_VIDEO;
+        }
+        if (ret != AVERROR(EAGAIN)) {
+            set_ff_error(v, ret, "video receive_frame failed");
+            return VNE_FRAME_ERROR;
+        }
+
+        if (v->eof) {
+            avcodec_send_packet(v->vdec, NULL);
+            v->vflushed = 1;
+            continue;
+        }
+        ret = read_packet(v, v->pkt);
+        if (ret == AVERROR_EOF) {
+            v->eof = 1;
+            continue;
+        }
+        if (ret < 0) {
+            set_ff_error(v, ret, "av_read_frame failed");
+            return VNE_FRAME_ERROR;
+        }
+        if (v->pkt->stream_index == v->vstream_index) {
+            avcodec_send_packet(v->vdec, v->pkt);
+        }
+        av_packet_unref(v->pkt);
+    }
+}
+
+VNEFrameType vne_video_frame_at_ms(VNEVideo *v, int64_t target_ms, VNEVideoFrame *out_video) {
+    if (!v || !out_video) return VNE_FRAME_ERROR;
+    if (v->opts.frame_cache_bytes <= 0 || v->opts.output_format != VNE_PIXEL_RGBA || !v->vdec) {
+        set_error(v, "frame access needs an RGBA video handle opened with frame_cache_bytes");
+        return VNE_FRAME_ERROR;
     }
+    if (v->async_running) {
+        set_error(v, "frame access is not available in async mode");
+        return VNE_FRAME_ERROR;
+    }
+    // Frames queued earlier (a preload, or a stopped async run) went through
+    // the frame cache when they were converted; the queue copies can go.
+    ring_drain(&v->vring);
+    ring_drain(&v->aring);
+    if (target_ms < 0) target_ms = 0;
 
-    return v;
+    vne_mutex_lock(&v->video_lock);
+    VNEFrameType t = VNE_FRAME_VIDEO;
+    VNECachedFrame *e = frame_cache_lookup(v, target_ms);
+    if (e) {
+        hand_out_cached(v, e, out_video);
+    } else {
+        t = decode_to(v, target_ms, out_video);
+        // Repeats are relative to frames decoded on the way, not shown.
+        if (t == VNE_FRAME_VIDEO) out_video->repeat = 0;
+    }
+    vne_mutex_unlock(&v->video_lock);
+    return t;
 }
 
-void vne_video_close(VNEVideo *v) {
-    if (!v) return;
+VNEFrameType vne_video_step_back(VNEVideo *v, VNEVideoFrame *out_video) {
+    if (!v || !out_video) return VNE_FRAME_ERROR;
+    if (v->scrub_pts_ms == AV_NOPTS_VALUE) {
+        set_error(v, "no current frame; call vne_video_frame_at_ms first");
+        return VNE_FRAME_ERROR;
+    }
+    int64_t cur = v->scrub_pts_ms;
+    if (cur <= 0) return VNE_FRAME_NONE;
 
-    if (v->pkt) av_packet_free(&v->pkt);
-    if (v->vframe) av_frame_free(&v->vframe);
-    if (v->aframe) av_frame_free(&v->aframe);
+    VNEFrameType t = vne_video_frame_at_ms(v, cur - 1, out_video);
+    // The first frame may start after 0; nothing earlier comes back then.
+    if (t == VNE_FRAME_VIDEO && out_video->pts_ms >= cur) {
+        vne_video_free_video_frame(out_video);
+        v->scrub_pts_ms = cur;
+        return VNE_FRAME_NONE;
+    }
+    return t;
+}
 
-    if (v->sws) sws_freeContext(v->sws);
-    if (v->swr) swr_free(&v->swr);
+// Drops everything tied to the open asset but keeps what a compatible next
+// asset can reuse: codec contexts, sws, swr, pools, frames, packets and the
+// AVIO buffer.
+static void release_asset(VNEVideo *v) {
+    async_stop(v);
+    ring_drain(&v->vring);
+    ring_drain(&v->aring);
+    pq_flush(&v->vqueue);
+    pq_flush(&v->aqueue);
+    frame_cache_clear(v);
+    repeat_reset(v);
 
-    if (v->vdec) avcodec_free_context(&v->vdec);
-    if (v->adec) avcodec_free_context(&v->adec);
+    if (v->vframe) av_frame_unref(v->vframe);
+    if (v->aframe) av_frame_unref(v->aframe);
+    if (v->vnext) av_frame_unref(v->vnext);
+    if (v->vdue) av_frame_unref(v->vdue);
+    v->vnext_valid = 0;
+    if (v->vdec) set_lag_level(v, 0);
+    if (v->sring.data) {
+        vne_atomic_store(&v->sring.flush, vne_atomic_load(&v->sring.tail));
+        vne_atomic_store(&v->sring.ended, 0);
+    }
 
     if (v->fmt) avformat_close_input(&v->fmt);
-    if (v->avio) avio_context_free(&v->avio);
+    if (v->avio) {
+        av_free(v->avio_buf);
+        v->avio_buf = v->avio->buffer;
+        v->avio_buf_size = v->avio->buffer_size;
+        v->avio->buffer = NULL;
+        avio_context_free(&v->avio);
+    }
     if (v->io) {
         if (v->io->fp) fclose(v->io->fp);
+        vne_map_unref(v->io->map);
         free(v->io);
+        v->io = NULL;
     }
+    free(v->kindex);
+    v->kindex = NULL;
+    v->kindex_count = 0;
+    stream_cache_free(v->cache);
+    v->cache = NULL;
 
-    free(v);
+    v->vstream = NULL;
+    v->astream = NULL;
+    v->vstream_index = -1;
+    v->astream_index = -1;
+    v->eof = 0;
+    v->vflushed = 0;
+    v->aflushed = 0;
+    v->video_skip_ms = AV_NOPTS_VALUE;
+    v->audio_skip_ms = AV_NOPTS_VALUE;
+    v->loop_end_ms = 0;
+    v->loop_offset_ms = 0;
+    v->loop_count = 0;
+    v->fcache_prev_pts = AV_NOPTS_VALUE;
+    v->scrub_pts_ms = AV_NOPTS_VALUE;
+    v->last_error[0] = '\0';
 }
 
-const char *vne_video_last_error(VNEVideo *v) {
-    if (!v) return "no handle";
-    return v->last_error[0] ? v->last_error : "";
+VNEVideo *vne_video_reopen(VNEVideo *v, const char *path, VNEVideoInfo *out_info) {
+    if (!v) return NULL;
+    if (!path) {
+        vne_video_close(v);
+        return NULL;
+    }
+
+    release_asset(v);
+    return open_path(v, path, out_info);
 }
 
-static int try_receive_video(VNEVideo *v, VNEVideoFrame *out_video) {
-    if (!v->vdec || !out_video) return 0;
+// Preloading: handles open on a small worker pool. Each item is claimed by
+// one worker and published through its state, so polling never blocks.
+#define VNE_PRELOAD_PENDING 0
+#define VNE_PRELOAD_READY   1
+#define VNE_PRELOAD_FAILED  (-1)
+#define VNE_PRELOAD_TAKEN   2
 
-    VNEF_LOG("[VIDEO] Entering try_receive_video\n");
-    fflush(stderr);
+typedef struct VNEPreloadItem {
+    char *path;
+    VNEVideo *video;
+    VNEVideoInfo info;
+    vne_atomic_int state;
+} VNEPreloadItem;
 
-    int ret = avcodec_receive_frame(v->vdec, v->vframe);
-    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-        VNEF_LOG("[VIDEO] No frame available (EAGAIN or EOF)\n");
-        fflush(stderr);
-        return 0;
-    }
-    if (ret < 0) {
-        set_ff_error(v, ret, "video receive_frame failed");
+struct VNEVideoPreload {
+    VNEOpenOptions opts;
+    VNEPreloadItem *items;
+    int count;
+    vne_atomic_int next;   // next item to claim
+    vne_atomic_int cancel;
+    vne_thread *threads;
+    int thread_count;
+};
+
+// Decodes the first video and audio frames into the frame queues, where
+// vne_video_next finds them before decoding anything itself.
+static int prime_handle(VNEVideo *v) {
+    if (ring_init(&v->vring, 8) < 0 || ring_init(&v->aring, 8) < 0) {
+        ring_free(&v->vring);
+        ring_free(&v->aring);
         return -1;
     }
 
-    VNEF_LOG("[VIDEO] Got video frame\n");
-    fflush(stderr);
-
-    int width = v->vframe->width;
-    int height = v->vframe->height;
-    enum AVPixelFormat fmt = (enum AVPixelFormat)v->vframe->format;
+    int need_video = v->vdec != NULL;
+    int need_audio = v->adec != NULL && !v->sring.data;
+    while ((need_video || need_audio) && !ring_full(&v->vring) && !ring_full(&v->aring)) {
+        VNEFrameSlot slot;
+        memset(&slot, 0, sizeof(slot));
+        VNEVideoTarget vt = { 0 };
+        if (v->opts.output_format == VNE_PIXEL_RGBA) {
+            vt.rgba = &slot.video;
+        } else {
+            vt.planar = &slot.planar;
+        }
 
-    if (width <= 0 || height <= 0) {
-        set_error(v, "invalid video frame size");
-        return -1;
+        VNEFrameType t = next_frame(v, &vt, &slot.audio);
+        if (t == VNE_FRAME_VIDEO) {
+            ring_push(&v->vring, &slot);
+            need_video = 0;
+        } else if (t == VNE_FRAME_AUDIO) {
+            ring_push(&v->aring, &slot);
+            need_audio = 0;
+        } else {
+            return t == VNE_FRAME_ERROR ? -1 : 0;
+        }
     }
+    return 0;
+}
 
-    if (!v->sws || v->sws_w != width || v->sws_h != height || v->sws_fmt != fmt) {
-        if (v->sws) sws_freeContext(v->sws);
-        v->sws = sws_getContext(
-            width,
-            height,
-            fmt,
-            width,
-            height,
-            AV_PIX_FMT_RGBA,
-            SWS_BILINEAR,
-            NULL,
-            NULL,
-            NULL
-        );
-        if (!v->sws) {
-            set_error(v, "failed to create sws context");
-            return -1;
+static void preload_worker(void *arg) {
+    VNEVideoPreload *p = (VNEVideoPreload *)arg;
+
+    while (!vne_atomic_load(&p->cancel)) {
+        int i = vne_atomic_add(&p->next, 1) - 1;
+        if (i >= p->count) break;
+
+        VNEPreloadItem *it = &p->items[i];
+        VNEVideo *v = vne_video_open_ex(it->path, &p->opts, &it->info);
+        if (v && prime_handle(v) < 0) {
+            vne_video_close(v);
+            v = NULL;
         }
-        v->sws_w = width;
-        v->sws_h = height;
-        v->sws_fmt = fmt;
+        it->video = v;
+        vne_atomic_store(&it->state, v ? VNE_PRELOAD_READY : VNE_PRELOAD_FAILED);
     }
-    
-    uint8_t *dst_data[4] = { 0 };
-    int dst_linesize[4] = { 0 };
+}
 
-    // Use av_image_alloc to allocate buffer with proper size and alignment
-    int buf_size = av_image_alloc(dst_data, dst_linesize, width, height, AV_PIX_FMT_RGBA, 32);
-    if (buf_size < 0) {
-        set_ff_error(v, buf_size, "failed to allocate video image buffer");
-        return -1;
+VNEVideoPreload *vne_video_preload_start(const char *const *paths, int count, const VNEOpenOptions *opts, int threads) {
+    if (!paths || count <= 0) return NULL;
+
+    VNEVideoPreload *p = (VNEVideoPreload *)calloc(1, sizeof(VNEVideoPreload));
+    if (!p) return NULL;
+    if (opts) {
+        p->opts = *opts;
+    } else {
+        vne_video_default_options(&p->opts);
     }
-    
-    VNEF_LOG("[VIDEO] av_image_alloc returned size=%d, buffer at %p\n", buf_size, (void*)dst_data[0]);
-    fflush(stderr);
 
-    int scaled = sws_scale(v->sws,
-        (const uint8_t * const *)v->vframe->data,
-        v->vframe->linesize,
-        0,
-        height,
-        dst_data,
-        dst_linesize
-    );
-    if (scaled <= 0) {
-        av_freep(&dst_data[0]);
-        set_error(v, "sws_scale failed");
-        return -1;
+    p->items = (VNEPreloadItem *)calloc((size_t)count, sizeof(VNEPreloadItem));
+    if (!p->items) {
+        free(p);
+        return NULL;
+    }
+    p->count = count;
+    for (int i = 0; i < count; i++) {
+        // A NULL path just fails that item.
+        const char *path = paths[i] ? paths[i] : "";
+        size_t len = strlen(path);
+        p->items[i].path = (char *)malloc(len + 1);
+        if (!p->items[i].path) {
+            p->count = i;
+            vne_video_preload_free(p);
+            return NULL;
+        }
+        memcpy(p->items[i].path, path, len + 1);
+        vne_atomic_store(&p->items[i].state, VNE_PRELOAD_PENDING);
     }
 
-    int64_t best_pts = v->vframe->best_effort_timestamp;
+    if (threads <= 0) threads = av_cpu_count();
+    if (threads > count) threads = count;
+    if (threads < 1) threads = 1;
+    p->threads = (vne_thread *)calloc((size_t)threads, sizeof(vne_thread));
+    if (!p->threads) {
+        vne_video_preload_free(p);
+        return NULL;
+    }
+    vne_atomic_store(&p->next, 0);
+    vne_atomic_store(&p->cancel, 0);
+    for (int i = 0; i < threads; i++) {
+        if (vne_thread_start(&p->threads[i], preload_worker, p) != 0) break;
+        p->thread_count++;
+    }
+    if (p->thread_count == 0) {
+        vne_video_preload_free(p);
+        return NULL;
+    }
+    return p;
+}
 
-    out_video->width = width;
-    out_video->height = height;
-    out_video->stride = dst_linesize[0];
-    out_video->data = dst_data[0];
-    out_video->pts_ms = pts_to_ms(v->vstream, best_pts);
+int vne_video_preload_poll(VNEVideoPreload *p, int index) {
+    if (!p || index < 0 || index >= p->count) return -1;
+    int state = vne_atomic_load(&p->items[index].state);
+    if (state == VNE_PRELOAD_TAKEN) return -1;
+    return state;
+}
 
-    VNEF_LOG("[VIDEO] Returning video buffer %p to caller\n", (void*)dst_data[0]);
-    fflush(stderr);
+VNEVideo *vne_video_preload_take(VNEVideoPreload *p, int index, VNEVideoInfo *out_info) {
+    if (!p || index < 0 || index >= p->count) return NULL;
+    VNEPreloadItem *it = &p->items[index];
+    if (vne_atomic_load(&it->state) != VNE_PRELOAD_READY) return NULL;
 
-    av_frame_unref(v->vframe);
-    return 1;
+    VNEVideo *v = it->video;
+    it->video = NULL;
+    if (out_info) *out_info = it->info;
+    vne_atomic_store(&it->state, VNE_PRELOAD_TAKEN);
+    return v;
 }
 
-static int try_receive_audio(VNEVideo *v, VNEAudioFrame *out_audio) {
-    if (!v->adec || !out_audio) return 0;
+void vne_video_preload_free(VNEVideoPreload *p) {
+    if (!p) return;
 
-    int ret = avcodec_receive_frame(v->adec, v->aframe);
-    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-        return 0;
-    }
-    if (ret < 0) {
-        set_ff_error(v, ret, "audio receive_frame failed");
-        return -1;
+    // Items no worker has claimed yet are skipped; claimed ones finish.
+    vne_atomic_store(&p->cancel, 1);
+    for (int i = 0; i < p->thread_count; i++) {
+        vne_thread_join(&p->threads[i]);
     }
+    free(p->threads);
 
-    int channels = v->adec->ch_layout.nb_channels > 0 ? v->adec->ch_layout.nb_channels : v->adec->channels;
-    int samples = v->aframe->nb_samples;
-    
-    VNEF_LOG("[AUDIO] Received frame: samples=%d channels=%d fmt=%s\n",
-            samples, channels, av_get_sample_fmt_name(v->adec->sample_fmt));
-    fflush(stderr);
-    
-    if (samples <= 0 || channels <= 0) {
-        set_error(v, "invalid audio frame: samples or channels <= 0");
-        av_frame_unref(v->aframe);
-        return -1;
+    for (int i = 0; i < p->count; i++) {
+        if (p->items[i].video) vne_video_close(p->items[i].video);
+        free(p->items[i].path);
     }
+    free(p->items);
+    free(p);
+}
 
-    // Calculate output buffer size
-    int64_t delay = swr_get_delay(v->swr, v->adec->sample_rate);
-    int max_out_samples = (int)av_rescale_rnd(delay + samples, v->adec->sample_rate, v->adec->sample_rate, AV_ROUND_UP);
-    if (max_out_samples <= 0) {
-        max_out_samples = samples;
-    }
-    
-    VNEF_LOG("[AUDIO] Calculating buffer: delay=%ld max_out_samples=%d\n", (long)delay, max_out_samples);
+// Scheduler: a fixed set of workers decodes for every registered handle, so
+// the thread count stays fixed however many videos are live. Each claim takes
+// the most urgent ready handle from one shared list under one lock; with the
+// handful of videos a scene shows, the scan costs far less than a frame. A
+// handle is decoded by at most one worker at a time (sched_busy), which keeps
+// its frame queues single-producer.
+struct VNEScheduler {
+    vne_mutex lock;        // guards handles and every claim
+    VNEVideo **handles;
+    int count;
+    int cap;
+    vne_thread *threads;
+    int thread_count;
+    vne_mutex idle_lock;
+    vne_cond idle_cond;
+    vne_atomic_int idle;   // workers waiting for work
+    vne_atomic_int quit;
+};
 
-    // Allocate output buffer - S16 is interleaved so we only need one buffer
-    int buf_size = av_samples_get_buffer_size(NULL, channels, max_out_samples, AV_SAMPLE_FMT_S16, 1);
-    if (buf_size < 0) {
-        set_ff_error(v, buf_size, "failed to calculate audio buffer size");
-        av_frame_unref(v->aframe);
-        return -1;
+static int sched_ready(VNEVideo *v, int64_t now_ms) {
+    return !vne_atomic_load(&v->sched_busy) && !vne_atomic_load(&v->async_quit) &&
+           vne_atomic_load(&v->async_state) == VNE_FRAME_NONE &&
+           !ring_full(&v->vring) && !ring_full(&v->aring) && now_ms >= v->sched_retry_ms;
+}
+
+// How far the queued frames reach past the one the consumer takes next. The
+// handle closest to running dry is due first; an empty queue is due now.
+static int64_t sched_ahead(VNEVideo *v) {
+    VNEFrameRing *r = v->vdec ? &v->vring : &v->aring;
+    VNEFrameSlot *slot = ring_peek(r);
+    if (!slot) return INT64_MIN;
+
+    int64_t head;
+    if (!v->vdec) {
+        head = slot->audio.pts_ms;
+    } else if (v->opts.output_format == VNE_PIXEL_RGBA) {
+        head = slot->video.pts_ms;
+    } else {
+        head = slot->planar.pts_ms;
     }
-    
-    VNEF_LOG("[AUDIO] Allocating %d bytes\n", buf_size);
+    return v->sched_tail_ms - head;
+}
 
-    uint8_t *out_buf = (uint8_t *)av_malloc((size_t)buf_size);
-    if (!out_buf) {
-        set_error(v, "failed to allocate audio output buffer");
-        av_frame_unref(v->aframe);
-        return -1;
+// Claims the most urgent ready handle, or returns NULL when none is ready.
+static VNEVideo *sched_claim(VNEScheduler *s) {
+    int64_t now_ms = av_gettime_relative() / 1000;
+    VNEVideo *best = NULL;
+    int64_t best_ahead = INT64_MAX;
+
+    vne_mutex_lock(&s->lock);
+    for (int i = 0; i < s->count; i++) {
+        VNEVideo *v = s->handles[i];
+        if (!sched_ready(v, now_ms)) continue;
+        int64_t ahead = sched_ahead(v);
+        if (!best || ahead < best_ahead) {
+            best = v;
+            best_ahead = ahead;
+        }
     }
-    
-    VNEF_LOG("[AUDIO] Allocated buffer at %p\n", (void*)out_buf);
+    if (best) vne_atomic_store(&best->sched_busy, 1);
+    vne_mutex_unlock(&s->lock);
+    return best;
+}
 
-    // Set up output pointer array for swr_convert (even for interleaved, needs array)
-    uint8_t *out_ptrs[1] = { out_buf };
+static void sched_worker(void *arg) {
+    VNEScheduler *s = (VNEScheduler *)arg;
 
-    // Convert/resample
-    int converted = swr_convert(
-        v->swr,
-        out_ptrs,
-        max_out_samples,
-        (const uint8_t **)v->aframe->data,
-        samples
-    );
+    while (!vne_atomic_load(&s->quit)) {
+        VNEVideo *v = sched_claim(s);
+        if (v) {
+            // One frame per claim, so a long clip cannot hog a worker.
+            if (async_step(v) == 0) {
+                v->sched_retry_ms = av_gettime_relative() / 1000 + 5;
+            }
+            vne_atomic_store(&v->sched_busy, 0);
+            continue;
+        }
 
-    if (converted < 0) {
-        VNEF_LOG("[AUDIO] swr_convert failed, freeing %p\n", (void*)out_buf);
-        set_ff_error(v, converted, "swr_convert failed");
-        av_freep(&out_buf);
-        av_frame_unref(v->aframe);
-        return -1;
+        vne_atomic_add(&s->idle, 1);
+        vne_mutex_lock(&s->idle_lock);
+        if (!vne_atomic_load(&s->quit)) {
+            vne_cond_wait_ms(&s->idle_cond, &s->idle_lock, 5);
+        }
+        vne_mutex_unlock(&s->idle_lock);
+        vne_atomic_add(&s->idle, -1);
     }
+}
 
-    if (converted == 0) {
-        VNEF_LOG("[AUDIO] swr_convert returned 0, freeing %p\n", (void*)out_buf);
-        set_error(v, "swr_convert returned 0 samples");
-        av_freep(&out_buf);
-        av_frame_unref(v->aframe);
-        return -1;
+static void sched_wake(VNEVideo *v) {
+    VNEScheduler *s = v->sched;
+    if (vne_atomic_load(&s->idle) > 0) {
+        vne_cond_signal(&s->idle_cond);
     }
-    
-    VNEF_LOG("[AUDIO] Converted %d samples\n", converted);
+}
 
-    // Calculate actual size of converted data
-    int actual_size = av_samples_get_buffer_size(NULL, channels, converted, AV_SAMPLE_FMT_S16, 1);
-    if (actual_size < 0) {
-        VNEF_LOG("[AUDIO] Failed to calc actual size, freeing %p\n", (void*)out_buf);
-        set_ff_error(v, actual_size, "failed to calculate converted buffer size");
-        av_freep(&out_buf);
-        av_frame_unref(v->aframe);
-        return -1;
+// Stops workers from claiming the handle and waits out one in progress.
+static void sched_pause(VNEVideo *v) {
+    VNEScheduler *s = v->sched;
+
+    // Claims test async_quit and set sched_busy under the lock, so once the
+    // lock is dropped no new claim can start.
+    vne_mutex_lock(&s->lock);
+    vne_atomic_store(&v->async_quit, 1);
+    vne_mutex_unlock(&s->lock);
+
+    while (vne_atomic_load(&v->sched_busy)) {
+        vne_mutex_lock(&s->idle_lock);
+        vne_cond_wait_ms(&s->idle_cond, &s->idle_lock, 1);
+        vne_mutex_unlock(&s->idle_lock);
     }
-    
-    VNEF_LOG("[AUDIO] Actual size: %d bytes (allocated: %d)\n", actual_size, buf_size);
+    v->async_running = 0;
+}
 
-    // DON'T trim - just return the full buffer to avoid any realloc issues
+static void sched_resume(VNEVideo *v) {
+    vne_atomic_store(&v->async_state, VNE_FRAME_NONE);
+    v->sched_retry_ms = 0;
+    v->async_running = 1;
+    vne_atomic_store(&v->async_quit, 0);
+    sched_wake(v);
+}
 
-    int64_t best_pts = v->aframe->best_effort_timestamp;
+VNEScheduler *vne_scheduler_create(int threads) {
+    if (threads <= 0) threads = av_cpu_count();
+    if (threads < 1) threads = 1;
 
-    out_audio->sample_rate = v->adec->sample_rate;
-    out_audio->channels = channels;
-    out_audio->nb_samples = converted;
-    out_audio->bytes_per_sample = 2;
-    out_audio->data = out_buf;
-    out_audio->pts_ms = pts_to_ms(v->astream, best_pts);
-    
-    VNEF_LOG("[AUDIO] Returning buffer %p to caller\n", (void*)out_buf);
-    fflush(stderr);
+    VNEScheduler *s = (VNEScheduler *)calloc(1, sizeof(VNEScheduler));
+    if (!s) return NULL;
+    s->threads = (vne_thread *)calloc((size_t)threads, sizeof(vne_thread));
+    if (!s->threads) {
+        free(s);
+        return NULL;
+    }
 
-    av_frame_unref(v->aframe);
-    return 1;
+    vne_mutex_init(&s->lock);
+    vne_mutex_init(&s->idle_lock);
+    vne_cond_init(&s->idle_cond);
+    vne_atomic_store(&s->idle, 0);
+    vne_atomic_store(&s->quit, 0);
+    for (int i = 0; i < threads; i++) {
+        if (vne_thread_start(&s->threads[i], sched_worker, s) != 0) break;
+        s->thread_count++;
+    }
+    if (s->thread_count == 0) {
+        vne_cond_destroy(&s->idle_cond);
+        vne_mutex_destroy(&s->idle_lock);
+        vne_mutex_destroy(&s->lock);
+        free(s->threads);
+        free(s);
+        return NULL;
+    }
+    return s;
 }
 
-VNEFrameType vne_video_next(VNEVideo *v, VNEVideoFrame *out_video, VNEAudioFrame *out_audio) {
-    if (!v) return VNE_FRAME_ERROR;
-
-    VNEF_LOG("[NEXT] vne_video_next called, out_video=%p out_audio=%p\n", (void*)out_video, (void*)out_audio);
-    fflush(stderr);
+int vne_scheduler_add(VNEScheduler *s, VNEVideo *v, int queue_depth) {
+    if (!s || !v) return -1;
+    if (v->sched == s) return 0;
+    if (v->sched) {
+        set_error(v, "handle already belongs to a scheduler");
+        return -1;
+    }
 
-    for (;;) {
-        VNEF_LOG("[NEXT] Loop iteration: trying video\n");
-        fflush(stderr);
-        int got = try_receive_video(v, out_video);
-        if (got == 1) {
-            VNEF_LOG("[NEXT] Returning VIDEO frame\n");
-            fflush(stderr);
-            return VNE_FRAME_VIDEO;
-        }
-        if (got < 0) return VNE_FRAME_ERROR;
+    // A handle with its own decode thread moves over to the shared workers.
+    async_stop(v);
+    if (async_rings(v, queue_depth) < 0) return -1;
 
-        VNEF_LOG("[NEXT] Trying audio\n");
-        fflush(stderr);
-        got = try_receive_audio(v, out_audio);
-        if (got == 1) {
-            VNEF_LOG("[NEXT] Returning AUDIO frame\n");
-            fflush(stderr);
-            return VNE_FRAME_AUDIO;
+    vne_mutex_lock(&s->lock);
+    if (s->count == s->cap) {
+        int cap = s->cap ? s->cap * 2 : 8;
+        VNEVideo **handles = (VNEVideo **)realloc(s->handles, (size_t)cap * sizeof(VNEVideo *));
+        if (!handles) {
+            vne_mutex_unlock(&s->lock);
+            set_error(v, "out of memory for scheduler handles");
+            return -1;
         }
-        if (got < 0) return VNE_FRAME_ERROR;
+        s->handles = handles;
+        s->cap = cap;
+    }
+    // Paused until registered, so no worker claims it half set up.
+    vne_atomic_store(&v->async_quit, 1);
+    vne_atomic_store(&v->sched_busy, 0);
+    v->sched = s;
+    s->handles[s->count++] = v;
+    vne_mutex_unlock(&s->lock);
 
-        if (v->eof) {
-            return VNE_FRAME_EOF;
-        }
+    sched_resume(v);
+    return 0;
+}
 
-        int ret = av_read_frame(v->fmt, v->pkt);
-        if (ret == AVERROR_EOF) {
-            v->eof = 1;
-            if (v->vdec) avcodec_send_packet(v->vdec, NULL);
-            if (v->adec) avcodec_send_packet(v->adec, NULL);
-            continue;
-        }
-        if (ret < 0) {
-            set_ff_error(v, ret, "av_read_frame failed");
-            return VNE_FRAME_ERROR;
-        }
+void vne_scheduler_remove(VNEScheduler *s, VNEVideo *v) {
+    if (!s || !v || v->sched != s) return;
 
-        if (v->pkt->stream_index == v->vstream_index) {
-            avcodec_send_packet(v->vdec, v->pkt);
-        } else if (v->pkt->stream_index == v->astream_index) {
-            if (v->adec) avcodec_send_packet(v->adec, v->pkt);
+    sched_pause(v);
+    vne_mutex_lock(&s->lock);
+    for (int i = 0; i < s->count; i++) {
+        if (s->handles[i] == v) {
+            s->handles[i] = s->handles[--s->count];
+            break;
         }
-
-        av_packet_unref(v->pkt);
     }
+    vne_mutex_unlock(&s->lock);
+    v->sched = NULL;
 }
 
-void vne_video_free_video_frame(VNEVideoFrame *f) {
-    if (!f) return;
-    VNEF_LOG("[VIDEO] Freeing video frame buffer %p\n", (void*)f->data);
-    fflush(stderr);
-    if (f->data) av_free(f->data);
-    f->data = NULL;
-    f->width = 0;
-    f->height = 0;
-    f->stride = 0;
-    f->pts_ms = 0;
-}
+void vne_scheduler_destroy(VNEScheduler *s) {
+    if (!s) return;
 
-void vne_video_free_audio_frame(VNEAudioFrame *f) {
-    if (!f) return;
-    if (f->data) {
-        VNEF_LOG("[AUDIO] Freeing audio frame buffer %p\n", (void*)f->data);
-        av_free(f->data);
+    vne_atomic_store(&s->quit, 1);
+    vne_mutex_lock(&s->idle_lock);
+    vne_cond_broadcast(&s->idle_cond);
+    vne_mutex_unlock(&s->idle_lock);
+    for (int i = 0; i < s->thread_count; i++) {
+        vne_thread_join(&s->threads[i]);
     }
-    f->data = NULL;
-    f->sample_rate = 0;
-    f->channels = 0;
-    f->nb_samples = 0;
-    f->bytes_per_sample = 0;
-    f->pts_ms = 0;
-}
-
-int vne_video_seek_ms(VNEVideo *v, int64_t target_ms) {
-    if (!v || !v->vstream) return -1;
 
-    int64_t ts = av_rescale_q(target_ms, (AVRational){1, 1000}, v->vstream->time_base);
-    int ret = av_seek_frame(v->fmt, v->vstream_index, ts, AVSEEK_FLAG_BACKWARD);
-    if (ret < 0) {
-        set_ff_error(v, ret, "av_seek_frame failed");
-        return -1;
+    // Handles stay open and fall back to synchronous decoding; frames already
+    // queued are still handed out first.
+    for (int i = 0; i < s->count; i++) {
+        s->handles[i]->async_running = 0;
+        s->handles[i]->sched = NULL;
     }
 
-    if (v->vdec) avcodec_flush_buffers(v->vdec);
-    if (v->adec) avcodec_flush_buffers(v->adec);
-    v->eof = 0;
-    return 0;
+    free(s->handles);
+    free(s->threads);
+    vne_cond_destroy(&s->idle_cond);
+    vne_mutex_destroy(&s->idle_lock);
+    vne_mutex_destroy(&s->lock);
+    free(s);
 }